@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <yaul.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dsp_transform.h"
+
+#define POINT_COUNT     100
+
+/* 30 degrees about Y, in 16.16 */
+#define COS_30          0x0000DDB4
+#define SIN_30          0x00008000
+
+static void _points_init(void);
+static int32_t _random_get(void);
+static uint32_t _batch_count_get(uint32_t);
+static uint32_t _batch_check(uint32_t, uint32_t);
+
+static const dsp_transform_matrix_t _matrix = {
+        .m = {
+                {  COS_30,          0, SIN_30, 10 << 10 },
+                {       0, 0x00010000,      0, -(5 << 10) },
+                { -SIN_30,          0, COS_30, 200 << 10 }
+        }
+};
+
+/* 22.10 */
+static dsp_transform_point_t _points[POINT_COUNT];
+static dsp_transform_point_t _transformed[POINT_COUNT];
+
+int
+main(void)
+{
+        dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+        dbgio_dev_font_load();
+        dbgio_dev_font_load_wait();
+
+        _points_init();
+
+        dsp_transform_init();
+        dsp_transform_matrix_set(&_matrix);
+
+        dbgio_printf("Transforming %u points in batches of %u\n",
+            POINT_COUNT, DSP_TRANSFORM_BATCH_COUNT);
+
+        uint32_t mismatch_count;
+        mismatch_count = 0;
+
+        uint32_t first;
+        first = 0;
+
+        uint32_t count;
+        count = _batch_count_get(0);
+
+        dsp_transform_batch_start(&_points[0], &_transformed[0], count);
+
+        while (count > 0) {
+                dsp_transform_batch_wait();
+
+                const uint32_t next = first + count;
+                const uint32_t next_count = _batch_count_get(next);
+
+                if (next_count > 0) {
+                        dsp_transform_batch_start(&_points[next],
+                            &_transformed[next], next_count);
+                }
+
+                /* Check the batch while the DSP transforms the next one */
+                mismatch_count += _batch_check(first, count);
+
+                first = next;
+                count = next_count;
+        }
+
+        if (mismatch_count == 0) {
+                dbgio_puts("Passed\n");
+        } else {
+                dbgio_printf("Failed: %lu mismatches\n", mismatch_count);
+        }
+
+        dbgio_flush();
+        vdp_sync();
+
+        while (true) {
+        }
+
+        return 0;
+}
+
+void
+user_init(void)
+{
+        vdp2_tvmd_display_res_set(VDP2_TVMD_INTERLACE_NONE, VDP2_TVMD_HORZ_NORMAL_A,
+            VDP2_TVMD_VERT_224);
+
+        vdp2_scrn_back_screen_color_set(VDP2_VRAM_ADDR(3, 0x01FFFE),
+            COLOR_RGB1555(1, 0, 3, 15));
+
+        cpu_intc_mask_set(0);
+
+        vdp2_tvmd_display_set();
+}
+
+static void
+_points_init(void)
+{
+        uint32_t i;
+        for (i = 0; i < POINT_COUNT; i++) {
+                _points[i].x = _random_get();
+                _points[i].y = _random_get();
+                _points[i].z = _random_get();
+        }
+}
+
+/* Within +/-256 units */
+static int32_t
+_random_get(void)
+{
+        static uint32_t seed = 0x12345678;
+
+        seed = (seed * 1103515245) + 12345;
+
+        return (int32_t)seed >> 13;
+}
+
+static uint32_t
+_batch_count_get(uint32_t first)
+{
+        const uint32_t count = POINT_COUNT - first;
+
+        if (count > DSP_TRANSFORM_BATCH_COUNT) {
+                return DSP_TRANSFORM_BATCH_COUNT;
+        }
+
+        return count;
+}
+
+static uint32_t
+_batch_check(uint32_t first, uint32_t count)
+{
+        uint32_t mismatch_count;
+        mismatch_count = 0;
+
+        uint32_t i;
+        for (i = first; i < (first + count); i++) {
+                const dsp_transform_point_t * const in = &_points[i];
+                const dsp_transform_point_t * const out = &_transformed[i];
+
+                int32_t expected[3];
+
+                uint32_t row;
+                for (row = 0; row < 3; row++) {
+                        const int32_t * const m = _matrix.m[row];
+
+                        const int64_t sum =
+                            ((int64_t)m[0] * in->x) +
+                            ((int64_t)m[1] * in->y) +
+                            ((int64_t)m[2] * in->z) +
+                            ((int64_t)m[3] << 16);
+
+                        expected[row] = sum >> 16;
+                }
+
+                if ((out->x != expected[0]) ||
+                    (out->y != expected[1]) ||
+                    (out->z != expected[2])) {
+                        if (mismatch_count == 0) {
+                                dbgio_printf("Point %lu: %08lX %08lX %08lX, expected %08lX %08lX %08lX\n",
+                                    i, out->x, out->y, out->z,
+                                    expected[0], expected[1], expected[2]);
+                        }
+
+                        mismatch_count++;
+                }
+        }
+
+        return mismatch_count;
+}
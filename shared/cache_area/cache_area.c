@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <yaul.h>
+
+#include "cache_area.h"
+
+#define CACHE_LINE_SIZE 16
+
+void
+cache_area_purge(const void *address, uint32_t size)
+{
+        uint32_t line;
+        line = (uint32_t)address & ~(CACHE_LINE_SIZE - 1);
+
+        const uint32_t end = (uint32_t)address + size;
+
+        for (; line < end; line += CACHE_LINE_SIZE) {
+                MEMORY_WRITE(32, CPU_CACHE_PURGE | line, 0x00000000);
+        }
+}
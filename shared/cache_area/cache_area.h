@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef _SHARED_CACHE_AREA_CACHE_AREA_H_
+#define _SHARED_CACHE_AREA_CACHE_AREA_H_
+
+#include <stdint.h>
+
+/* Purges every cache line covering [address, address + size) from the
+ * calling CPU's cache. For memory written behind the cache's back (by the
+ * other CPU, or by DMA), where purging the whole cache would be wasteful */
+void cache_area_purge(const void *address, uint32_t size);
+
+#endif /* _SHARED_CACHE_AREA_CACHE_AREA_H_ */
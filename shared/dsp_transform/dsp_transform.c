@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <assert.h>
+
+#include <yaul.h>
+
+#include "cache_area.h"
+#include "dsp_transform.h"
+
+/* Parameter words in RAM0, right after the matrix */
+#define PARAMS_OFFSET   13
+
+/* 1.0 in 16.16, multiplied with the translation */
+#define ONE_OFFSET      3
+#define ONE             0x00010000
+
+/* D0 addresses are in longs */
+#define DMA_ADDRESS(x)  (((uint32_t)(x) & 0x07FFFFFF) >> 2)
+
+/* The only work RAM the SCU can reach */
+#define HIGH_WORK_RAM_START     0x06000000
+#define HIGH_WORK_RAM_END       0x06100000
+
+/* Regenerate with make -C host program */
+static const uint32_t _program[] = {
+#include "dsp_transform.inc"
+};
+
+static dsp_transform_point_t *_out = NULL;
+static uint32_t _out_count = 0;
+
+/* Only used in asserts */
+static bool _dma_area_valid(const void *, uint32_t) __unused;
+
+void
+dsp_transform_init(void)
+{
+        scu_dsp_program_clear();
+        scu_dsp_program_load(&_program[0], sizeof(_program) / sizeof(*_program));
+
+        _out = NULL;
+        _out_count = 0;
+}
+
+void
+dsp_transform_matrix_set(const dsp_transform_matrix_t *matrix)
+{
+        const uint32_t one = ONE;
+
+        scu_dsp_data_write(0, 0, (void *)&matrix->m[0][0], 12);
+        scu_dsp_data_write(3, ONE_OFFSET, (void *)&one, 1);
+}
+
+void
+dsp_transform_batch_start(const dsp_transform_point_t *in,
+    dsp_transform_point_t *out, uint32_t count)
+{
+        assert(_out == NULL);
+        assert((count > 0) && (count <= DSP_TRANSFORM_BATCH_COUNT));
+        assert(_dma_area_valid(in, count * sizeof(dsp_transform_point_t)));
+        assert(_dma_area_valid(out, count * sizeof(dsp_transform_point_t)));
+
+        uint32_t params[4];
+
+        params[0] = DMA_ADDRESS(in);
+        params[1] = DMA_ADDRESS(out);
+        params[2] = count * 3;
+        params[3] = count - 1;
+
+        scu_dsp_data_write(0, PARAMS_OFFSET, params, 4);
+
+        _out = out;
+        _out_count = count;
+
+        scu_dsp_program_pc_set(0);
+        scu_dsp_program_start();
+}
+
+void
+dsp_transform_batch_wait(void)
+{
+        assert(_out != NULL);
+
+        scu_dsp_program_end_wait();
+
+        /* The DSP wrote behind the cache's back */
+        cache_area_purge(_out, _out_count * sizeof(dsp_transform_point_t));
+
+        _out = NULL;
+        _out_count = 0;
+}
+
+/* DMA_ADDRESS() would silently turn any other address into one in some
+ * other area. Either the cached or the cache-through address is fine */
+static bool
+_dma_area_valid(const void *address, uint32_t size)
+{
+        const uint32_t start = (uint32_t)address & 0x07FFFFFF;
+        const uint32_t end = start + size;
+
+        return (((start & 0x00000003) == 0) &&
+                (start >= HIGH_WORK_RAM_START) &&
+                (end <= HIGH_WORK_RAM_END));
+}
@@ -0,0 +1,79 @@
+; Transforms a batch of points by a 3x4 matrix
+;
+; RAM0[0..11] Matrix, row major. Rotation in 16.16, translation in the format
+;             of the points
+; RAM0[13]    Source address >> 2
+; RAM0[14]    Destination address >> 2
+; RAM0[15]    Word count (3 * point count)
+; RAM0[16]    Point count - 1
+; RAM1        Points, DMA'd in from the source address
+; RAM2        Transformed points, DMA'd out to the destination address
+; RAM3[0..2]  Current point
+; RAM3[3]     1.0 in 16.16, so that the translation goes through the same
+;             multiply-accumulate as the rotation
+;
+; Each row is a 48-bit sum of four products, and ALH drops the 16 fractional
+; bits of the rotation. Each point takes 25 cycles
+;
+; DMA1 and DMA2 are the add modes that step the D0 address by one long when
+; reading and when writing, respectively
+
+Start:
+; ALU     X-bus                   Y-bus                   D1-bus
+  NOP     NOP                     NOP                     MOV 13, CT0
+  NOP     NOP                     NOP                     MOV MC0, RA0
+  NOP     NOP                     NOP                     MOV MC0, WA0
+  NOP     NOP                     NOP                     MOV 0, CT1
+  DMA1 D0, MC1, M0
+WaitIn:
+  JMP T0, WaitIn
+  NOP
+  NOP     NOP                     NOP                     MOV 16, CT0
+  NOP     NOP                     NOP                     MOV M0, LOP
+  NOP     NOP                     NOP                     MOV 0, CT0
+  NOP     NOP                     NOP                     MOV 0, CT1
+  NOP     NOP                     NOP                     MOV 0, CT2
+  NOP     NOP                     NOP                     MOV Point, TOP
+
+Point:
+; Copy the point next to 1.0, so that each row reads four consecutive words
+  NOP     NOP                     NOP                     MOV 0, CT3
+  NOP     NOP                     NOP                     MOV MC1, MC3
+  NOP     NOP                     NOP                     MOV MC1, MC3
+  NOP     NOP                     NOP                     MOV MC1, MC3
+  NOP     NOP                     NOP                     MOV 0, CT3
+
+; X
+  NOP     MOV MC0, X              MOV MC3, Y              NOP
+  NOP     MOV MUL, P  MOV MC0, X  CLR A      MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P              MOV ALU, A              MOV 0, CT3
+  AD2     NOP                     NOP                     MOV ALH, MC2
+
+; Y
+  NOP     MOV MC0, X              MOV MC3, Y              NOP
+  NOP     MOV MUL, P  MOV MC0, X  CLR A      MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P              MOV ALU, A              MOV 0, CT3
+  AD2     NOP                     NOP                     MOV ALH, MC2
+
+; Z
+  NOP     MOV MC0, X              MOV MC3, Y              NOP
+  NOP     MOV MUL, P  MOV MC0, X  CLR A      MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P  MOV MC0, X  MOV ALU, A MOV MC3, Y   NOP
+  AD2     MOV MUL, P              MOV ALU, A              MOV 0, CT0
+  AD2     NOP                     NOP                     MOV ALH, MC2
+
+  BTM
+  NOP
+
+  NOP     NOP                     NOP                     MOV 15, CT0
+  NOP     NOP                     NOP                     MOV 0, CT2
+  DMA2 MC2, D0, M0
+WaitOut:
+  JMP T0, WaitOut
+  NOP
+  ENDI
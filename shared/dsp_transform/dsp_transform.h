@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef _SHARED_DSP_TRANSFORM_DSP_TRANSFORM_H_
+#define _SHARED_DSP_TRANSFORM_DSP_TRANSFORM_H_
+
+#include <stdint.h>
+
+/* Transforms points by a 3x4 matrix on the SCU DSP.
+ *
+ * The DSP DMAs the points in from, and the transformed points back out to,
+ * high work RAM on its own. Once a batch is started, the CPU is free until
+ * dsp_transform_batch_wait() is called, so a batch can be transformed while
+ * the previous one is being projected.
+ *
+ * The rotation is in 16.16. The points and the translation share a format,
+ * and the transformed points come out in that same format (22.10 for
+ * vdp1-mic3d). */
+
+/* Points that fit in a 64 word DSP RAM page */
+#define DSP_TRANSFORM_BATCH_COUNT 21
+
+typedef struct {
+        int32_t x;
+        int32_t y;
+        int32_t z;
+} __attribute__ ((packed, aligned(4))) dsp_transform_point_t;
+
+/* Row major, with the translation in column 3 */
+typedef struct {
+        int32_t m[3][4];
+} __attribute__ ((aligned(4))) dsp_transform_matrix_t;
+
+void dsp_transform_init(void);
+
+/* Applies to every batch started afterwards */
+void dsp_transform_matrix_set(const dsp_transform_matrix_t *);
+
+/* Both buffers must be in high work RAM, which is the only work RAM the SCU
+ * can reach, and 4-byte aligned. At most DSP_TRANSFORM_BATCH_COUNT points */
+void dsp_transform_batch_start(const dsp_transform_point_t *,
+    dsp_transform_point_t *, uint32_t);
+void dsp_transform_batch_wait(void);
+
+#endif /* _SHARED_DSP_TRANSFORM_DSP_TRANSFORM_H_ */
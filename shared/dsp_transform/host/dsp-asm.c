@@ -0,0 +1,776 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* Assembles SCU DSP source into a list of C initializers, one opcode per
+ * line, to be included into a program array.
+ *
+ *   dsp-asm input.dsp output.inc
+ *
+ * An operation line holds any of an ALU op, X-bus ops, Y-bus ops and a D1-bus
+ * op, in any order. NOP may appear anywhere. Also supported are MVI, JMP,
+ * BTM, LPS, END, ENDI, and DMA/DMAH with an optional add mode suffix (DMA1,
+ * DMA2, ...). Immediates are decimal, $hex or labels, with an optional #.
+ * Comments start with ; */
+
+#define LINE_COUNT_MAX  1024
+#define LABEL_COUNT_MAX 256
+#define TOKEN_COUNT_MAX 32
+#define PROGRAM_MAX     256
+
+typedef struct {
+        char name[256];
+        uint32_t address;
+} label_t;
+
+typedef struct {
+        char text[256];
+        uint32_t line_number;
+} line_t;
+
+static label_t _labels[LABEL_COUNT_MAX];
+static uint32_t _label_count = 0;
+
+static line_t _lines[LINE_COUNT_MAX];
+static uint32_t _line_count = 0;
+
+static const char *_path;
+static uint32_t _line_number;
+
+static bool _source_read(const char *);
+static uint32_t _tokenize(char *, char **);
+
+static bool _assemble(const char *, uint32_t *);
+static bool _op_assemble(char **, uint32_t, uint32_t *);
+static bool _dma_assemble(char **, uint32_t, uint32_t *);
+static bool _jmp_assemble(char **, uint32_t, uint32_t *);
+static bool _mvi_assemble(char **, uint32_t, uint32_t *);
+
+static int32_t _register_find(const char * const *, uint32_t, const char *);
+static int32_t _condition_get(const char *);
+static bool _immediate_get(const char *, int32_t *);
+
+static bool _error(const char *, const char *);
+
+/* Indexed by their encoding */
+static const char * const _alu_ops[] = {
+        "NOP", "AND", "OR", "XOR", "ADD", "SUB", "AD2", NULL,
+        "SR", "RR", "SL", "RL", NULL, NULL, NULL, "RL8"
+};
+
+static const char * const _sources[] = {
+        "M0", "M1", "M2", "M3", "MC0", "MC1", "MC2", "MC3",
+        NULL, "ALL", "ALH"
+};
+
+static const char * const _d1_destinations[] = {
+        "MC0", "MC1", "MC2", "MC3", "RX", "PL", "RA0", "WA0",
+        NULL, NULL, "LOP", "TOP", "CT0", "CT1", "CT2", "CT3"
+};
+
+static const char * const _mvi_destinations[] = {
+        "MC0", "MC1", "MC2", "MC3", "RX", "PL", "RA0", "WA0",
+        NULL, NULL, "LOP", NULL, "PC"
+};
+
+static const char * const _dma_rams[] = {
+        "MC0", "MC1", "MC2", "MC3", "PRG"
+};
+
+#define ELEMENT_COUNT(n) (sizeof((n)) / sizeof(*(n)))
+
+int
+main(int argc, char *argv[])
+{
+        if (argc != 3) {
+                fprintf(stderr, "Usage: %s input.dsp output.inc\n", argv[0]);
+
+                return 1;
+        }
+
+        if (!_source_read(argv[1])) {
+                return 1;
+        }
+
+        FILE *fp;
+        fp = fopen(argv[2], "w");
+
+        if (fp == NULL) {
+                fprintf(stderr, "Unable to open %s\n", argv[2]);
+
+                return 1;
+        }
+
+        const char *name;
+        name = strrchr(argv[1], '/');
+        name = (name != NULL) ? (name + 1) : argv[1];
+
+        fprintf(fp, "/* Generated from %s by dsp-asm. Do not edit */\n", name);
+
+        uint32_t i;
+
+        for (i = 0; i < _line_count; i++) {
+                uint32_t opcode;
+
+                _line_number = _lines[i].line_number;
+
+                if (!_assemble(_lines[i].text, &opcode)) {
+                        (void)fclose(fp);
+                        (void)remove(argv[2]);
+
+                        return 1;
+                }
+
+                fprintf(fp, "        0x%08X, /* %02X: %s */\n", opcode, i, _lines[i].text);
+        }
+
+        (void)fclose(fp);
+
+        printf("%s: %u opcodes\n", argv[2], _line_count);
+
+        return 0;
+}
+
+/* First pass: strips comments, records labels and keeps one line per
+ * opcode */
+static bool
+_source_read(const char *path)
+{
+        _path = path;
+
+        FILE *fp;
+        fp = fopen(path, "r");
+
+        if (fp == NULL) {
+                fprintf(stderr, "Unable to open %s\n", path);
+
+                return false;
+        }
+
+        char buffer[256];
+
+        _line_number = 0;
+
+        while ((fgets(buffer, sizeof(buffer), fp)) != NULL) {
+                _line_number++;
+
+                char *comment;
+                comment = strchr(buffer, ';');
+
+                if (comment != NULL) {
+                        *comment = '\0';
+                }
+
+                char *text;
+                text = buffer;
+
+                while (isspace((unsigned char)*text)) {
+                        text++;
+                }
+
+                char *colon;
+                colon = strchr(text, ':');
+
+                if (colon != NULL) {
+                        *colon = '\0';
+
+                        if (_label_count == LABEL_COUNT_MAX) {
+                                (void)fclose(fp);
+
+                                return _error("Too many labels", text);
+                        }
+
+                        label_t * const label = &_labels[_label_count];
+
+                        (void)snprintf(label->name, sizeof(label->name), "%s", text);
+                        label->address = _line_count;
+
+                        _label_count++;
+
+                        text = colon + 1;
+
+                        while (isspace((unsigned char)*text)) {
+                                text++;
+                        }
+                }
+
+                char *end;
+                end = &text[strlen(text)];
+
+                while ((end > text) && isspace((unsigned char)end[-1])) {
+                        end--;
+                }
+
+                *end = '\0';
+
+                if (*text == '\0') {
+                        continue;
+                }
+
+                if (_line_count == PROGRAM_MAX) {
+                        (void)fclose(fp);
+
+                        return _error("Program too large", text);
+                }
+
+                line_t * const line = &_lines[_line_count];
+
+                /* Collapse the columns, the text is echoed in the output */
+                char *p;
+                p = line->text;
+
+                for (; *text != '\0'; text++) {
+                        if (!isspace((unsigned char)*text)) {
+                                *p++ = *text;
+                        } else if (!isspace((unsigned char)text[1])) {
+                                *p++ = ' ';
+                        }
+                }
+
+                *p = '\0';
+
+                line->line_number = _line_number;
+
+                _line_count++;
+        }
+
+        (void)fclose(fp);
+
+        return true;
+}
+
+static uint32_t
+_tokenize(char *text, char **tokens)
+{
+        uint32_t token_count;
+        token_count = 0;
+
+        char *token;
+
+        for (token = strtok(text, " \t,"); token != NULL; token = strtok(NULL, " \t,")) {
+                if (token_count == TOKEN_COUNT_MAX) {
+                        break;
+                }
+
+                tokens[token_count] = token;
+                token_count++;
+        }
+
+        return token_count;
+}
+
+static bool
+_assemble(const char *text, uint32_t *opcode)
+{
+        char buffer[256];
+        (void)snprintf(buffer, sizeof(buffer), "%s", text);
+
+        char *tokens[TOKEN_COUNT_MAX];
+        const uint32_t token_count = _tokenize(buffer, tokens);
+
+        *opcode = 0x00000000;
+
+        if (token_count == 0) {
+                return _error("Expected an opcode", text);
+        }
+
+        if (strncasecmp(tokens[0], "DMA", 3) == 0) {
+                return _dma_assemble(tokens, token_count, opcode);
+        }
+
+        if (strcasecmp(tokens[0], "JMP") == 0) {
+                return _jmp_assemble(tokens, token_count, opcode);
+        }
+
+        if (strcasecmp(tokens[0], "MVI") == 0) {
+                return _mvi_assemble(tokens, token_count, opcode);
+        }
+
+        if (token_count == 1) {
+                if (strcasecmp(tokens[0], "BTM") == 0) {
+                        *opcode = 0xE0000000;
+
+                        return true;
+                }
+
+                if (strcasecmp(tokens[0], "LPS") == 0) {
+                        *opcode = 0xE8000000;
+
+                        return true;
+                }
+
+                if (strcasecmp(tokens[0], "END") == 0) {
+                        *opcode = 0xF0000000;
+
+                        return true;
+                }
+
+                if (strcasecmp(tokens[0], "ENDI") == 0) {
+                        *opcode = 0xF8000000;
+
+                        return true;
+                }
+        }
+
+        return _op_assemble(tokens, token_count, opcode);
+}
+
+/* Bus fields are only allowed to be set once per opcode */
+static bool
+_op_assemble(char **tokens, uint32_t token_count, uint32_t *opcode)
+{
+        bool alu_set = false;
+        bool x_set = false;
+        bool p_set = false;
+        bool y_set = false;
+        bool a_set = false;
+        bool d1_set = false;
+
+        int32_t x_source = -1;
+        int32_t y_source = -1;
+
+        uint32_t i;
+
+        for (i = 0; i < token_count; i++) {
+                const char * const token = tokens[i];
+
+                if (strcasecmp(token, "NOP") == 0) {
+                        continue;
+                }
+
+                const int32_t alu_op =
+                    _register_find(_alu_ops, ELEMENT_COUNT(_alu_ops), token);
+
+                if (alu_op >= 0) {
+                        if (alu_set) {
+                                return _error("More than one ALU op", token);
+                        }
+
+                        *opcode |= (uint32_t)alu_op << 26;
+                        alu_set = true;
+
+                        continue;
+                }
+
+                if (strcasecmp(token, "CLR") == 0) {
+                        if (((i + 1) >= token_count) || (strcasecmp(tokens[i + 1], "A") != 0)) {
+                                return _error("Expected CLR A", token);
+                        }
+
+                        if (a_set) {
+                                return _error("More than one op on A", token);
+                        }
+
+                        *opcode |= 0x1 << 17;
+                        a_set = true;
+                        i++;
+
+                        continue;
+                }
+
+                if (strcasecmp(token, "MOV") != 0) {
+                        return _error("Unknown op", token);
+                }
+
+                if ((i + 2) >= token_count) {
+                        return _error("Expected MOV source, destination", token);
+                }
+
+                const char * const source = tokens[i + 1];
+                const char * const destination = tokens[i + 2];
+
+                i += 2;
+
+                const int32_t source_index =
+                    _register_find(_sources, 8, source);
+
+                if (strcasecmp(destination, "X") == 0) {
+                        if (x_set || (source_index < 0)) {
+                                return _error("Invalid X-bus op", source);
+                        }
+
+                        if ((x_source >= 0) && (x_source != source_index)) {
+                                return _error("X-bus source already used", source);
+                        }
+
+                        *opcode |= (0x1 << 25) | ((uint32_t)source_index << 20);
+                        x_set = true;
+                        x_source = source_index;
+                } else if (strcasecmp(destination, "P") == 0) {
+                        if (p_set) {
+                                return _error("More than one op on P", source);
+                        }
+
+                        if (strcasecmp(source, "MUL") == 0) {
+                                *opcode |= 0x2 << 23;
+                        } else {
+                                if (source_index < 0) {
+                                        return _error("Invalid P source", source);
+                                }
+
+                                if ((x_source >= 0) && (x_source != source_index)) {
+                                        return _error("X-bus source already used", source);
+                                }
+
+                                *opcode |= (0x3 << 23) | ((uint32_t)source_index << 20);
+                                x_source = source_index;
+                        }
+
+                        p_set = true;
+                } else if (strcasecmp(destination, "Y") == 0) {
+                        if (y_set || (source_index < 0)) {
+                                return _error("Invalid Y-bus op", source);
+                        }
+
+                        if ((y_source >= 0) && (y_source != source_index)) {
+                                return _error("Y-bus source already used", source);
+                        }
+
+                        *opcode |= (0x1 << 19) | ((uint32_t)source_index << 14);
+                        y_set = true;
+                        y_source = source_index;
+                } else if (strcasecmp(destination, "A") == 0) {
+                        if (a_set) {
+                                return _error("More than one op on A", source);
+                        }
+
+                        if (strcasecmp(source, "ALU") == 0) {
+                                *opcode |= 0x2 << 17;
+                        } else {
+                                if (source_index < 0) {
+                                        return _error("Invalid A source", source);
+                                }
+
+                                if ((y_source >= 0) && (y_source != source_index)) {
+                                        return _error("Y-bus source already used", source);
+                                }
+
+                                *opcode |= (0x3 << 17) | ((uint32_t)source_index << 14);
+                                y_source = source_index;
+                        }
+
+                        a_set = true;
+                } else {
+                        if (d1_set) {
+                                return _error("More than one D1-bus op", source);
+                        }
+
+                        const int32_t destination_index =
+                            _register_find(_d1_destinations, ELEMENT_COUNT(_d1_destinations), destination);
+
+                        if (destination_index < 0) {
+                                return _error("Invalid D1-bus destination", destination);
+                        }
+
+                        const int32_t d1_source_index =
+                            _register_find(_sources, ELEMENT_COUNT(_sources), source);
+
+                        if (d1_source_index >= 0) {
+                                *opcode |= (0x3 << 12) |
+                                    ((uint32_t)destination_index << 8) |
+                                    (uint32_t)d1_source_index;
+                        } else {
+                                int32_t immediate;
+
+                                if (!_immediate_get(source, &immediate)) {
+                                        return false;
+                                }
+
+                                /* Sign extended */
+                                if ((immediate < -128) || (immediate > 255)) {
+                                        return _error("Immediate out of range", source);
+                                }
+
+                                *opcode |= (0x1 << 12) |
+                                    ((uint32_t)destination_index << 8) |
+                                    ((uint32_t)immediate & 0xFF);
+                        }
+
+                        d1_set = true;
+                }
+        }
+
+        return true;
+}
+
+/* DMA[H][add] D0, RAM, count or DMA[H][add] RAM, D0, count, where count is an
+ * immediate or a RAM register */
+static bool
+_dma_assemble(char **tokens, uint32_t token_count, uint32_t *opcode)
+{
+        static const uint32_t add_values[] = {
+                0, 1, 2, 4, 8, 16, 32, 64
+        };
+
+        if (token_count != 4) {
+                return _error("Expected DMA source, destination, count", tokens[0]);
+        }
+
+        const char *suffix;
+        suffix = &tokens[0][3];
+
+        *opcode = 0xC0000000;
+
+        if (toupper((unsigned char)*suffix) == 'H') {
+                *opcode |= 0x1 << 14;
+                suffix++;
+        }
+
+        uint32_t add_mode;
+        add_mode = 0;
+
+        if (*suffix != '\0') {
+                char *end;
+                const uint32_t add_value = strtoul(suffix, &end, 10);
+
+                if (*end != '\0') {
+                        return _error("Invalid DMA add mode", tokens[0]);
+                }
+
+                for (add_mode = 0; add_mode < ELEMENT_COUNT(add_values); add_mode++) {
+                        if (add_values[add_mode] == add_value) {
+                                break;
+                        }
+                }
+
+                if (add_mode == ELEMENT_COUNT(add_values)) {
+                        return _error("Invalid DMA add mode", tokens[0]);
+                }
+        }
+
+        *opcode |= add_mode << 15;
+
+        int32_t ram;
+
+        if (strcasecmp(tokens[1], "D0") == 0) {
+                ram = _register_find(_dma_rams, ELEMENT_COUNT(_dma_rams), tokens[2]);
+        } else if (strcasecmp(tokens[2], "D0") == 0) {
+                ram = _register_find(_dma_rams, 4, tokens[1]);
+
+                *opcode |= 0x1 << 12;
+        } else {
+                return _error("Expected D0 as the source or destination", tokens[1]);
+        }
+
+        if (ram < 0) {
+                return _error("Invalid DMA RAM", tokens[1]);
+        }
+
+        *opcode |= (uint32_t)ram << 8;
+
+        const int32_t count_register = _register_find(_sources, 8, tokens[3]);
+
+        if (count_register >= 0) {
+                *opcode |= (0x1 << 13) | (uint32_t)count_register;
+        } else {
+                int32_t count;
+
+                if (!_immediate_get(tokens[3], &count)) {
+                        return false;
+                }
+
+                if ((count < 0) || (count > 255)) {
+                        return _error("DMA count out of range", tokens[3]);
+                }
+
+                *opcode |= (uint32_t)count;
+        }
+
+        return true;
+}
+
+/* JMP address or JMP condition, address */
+static bool
+_jmp_assemble(char **tokens, uint32_t token_count, uint32_t *opcode)
+{
+        *opcode = 0xD0000000;
+
+        const char *target;
+
+        if (token_count == 2) {
+                target = tokens[1];
+        } else if (token_count == 3) {
+                const int32_t condition = _condition_get(tokens[1]);
+
+                if (condition < 0) {
+                        return _error("Invalid condition", tokens[1]);
+                }
+
+                *opcode |= (0x1 << 25) | ((uint32_t)condition << 19);
+
+                target = tokens[2];
+        } else {
+                return _error("Expected JMP [condition,] address", tokens[0]);
+        }
+
+        int32_t address;
+
+        if (!_immediate_get(target, &address)) {
+                return false;
+        }
+
+        if ((address < 0) || (address > 255)) {
+                return _error("Jump out of range", target);
+        }
+
+        *opcode |= (uint32_t)address;
+
+        return true;
+}
+
+/* MVI immediate, destination [, condition] */
+static bool
+_mvi_assemble(char **tokens, uint32_t token_count, uint32_t *opcode)
+{
+        if ((token_count != 3) && (token_count != 4)) {
+                return _error("Expected MVI immediate, destination[, condition]", tokens[0]);
+        }
+
+        const int32_t destination =
+            _register_find(_mvi_destinations, ELEMENT_COUNT(_mvi_destinations), tokens[2]);
+
+        if (destination < 0) {
+                return _error("Invalid MVI destination", tokens[2]);
+        }
+
+        int32_t immediate;
+
+        if (!_immediate_get(tokens[1], &immediate)) {
+                return false;
+        }
+
+        *opcode = 0x80000000 | ((uint32_t)destination << 26);
+
+        if (token_count == 3) {
+                if ((immediate < -(1 << 24)) || (immediate >= (1 << 25))) {
+                        return _error("Immediate out of range", tokens[1]);
+                }
+
+                *opcode |= (uint32_t)immediate & 0x01FFFFFF;
+        } else {
+                const int32_t condition = _condition_get(tokens[3]);
+
+                if (condition < 0) {
+                        return _error("Invalid condition", tokens[3]);
+                }
+
+                if ((immediate < -(1 << 18)) || (immediate >= (1 << 19))) {
+                        return _error("Immediate out of range", tokens[1]);
+                }
+
+                *opcode |= (0x1 << 25) | ((uint32_t)condition << 19) |
+                    ((uint32_t)immediate & 0x0007FFFF);
+        }
+
+        return true;
+}
+
+static int32_t
+_register_find(const char * const *names, uint32_t count, const char *token)
+{
+        uint32_t i;
+
+        for (i = 0; i < count; i++) {
+                if ((names[i] != NULL) && (strcasecmp(names[i], token) == 0)) {
+                        return i;
+                }
+        }
+
+        return -1;
+}
+
+/* Bit 5 is set when the condition is met on the flag being set */
+static int32_t
+_condition_get(const char *token)
+{
+        static const struct {
+                const char *name;
+                int32_t condition;
+        } conditions[] = {
+                { "Z",   0x21 },
+                { "NZ",  0x01 },
+                { "S",   0x22 },
+                { "NS",  0x02 },
+                { "ZS",  0x23 },
+                { "NZS", 0x03 },
+                { "C",   0x24 },
+                { "NC",  0x04 },
+                { "T0",  0x28 },
+                { "NT0", 0x08 }
+        };
+
+        uint32_t i;
+
+        for (i = 0; i < ELEMENT_COUNT(conditions); i++) {
+                if (strcasecmp(conditions[i].name, token) == 0) {
+                        return conditions[i].condition;
+                }
+        }
+
+        return -1;
+}
+
+static bool
+_immediate_get(const char *token, int32_t *value)
+{
+        if (*token == '#') {
+                token++;
+        }
+
+        uint32_t i;
+
+        for (i = 0; i < _label_count; i++) {
+                if (strcmp(_labels[i].name, token) == 0) {
+                        *value = _labels[i].address;
+
+                        return true;
+                }
+        }
+
+        bool negative;
+        negative = (*token == '-');
+
+        if (negative) {
+                token++;
+        }
+
+        int base;
+        base = 10;
+
+        if (*token == '$') {
+                base = 16;
+                token++;
+        }
+
+        char *end;
+        const uint32_t magnitude = strtoul(token, &end, base);
+
+        if ((*token == '\0') || (*end != '\0')) {
+                return _error("Invalid immediate or unknown label", token);
+        }
+
+        *value = (negative) ? -(int32_t)magnitude : (int32_t)magnitude;
+
+        return true;
+}
+
+static bool
+_error(const char *message, const char *token)
+{
+        fprintf(stderr, "%s:%u: %s: %s\n", _path, _line_number, message, token);
+
+        return false;
+}
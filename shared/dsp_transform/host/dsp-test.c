@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2012-2016 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Runs the assembled transform program on a model of the SCU DSP, and checks
+ * its output against the transform done in C.
+ *
+ *   dsp-test [batch-count]
+ *
+ * Only what the program uses is modelled. Any other opcode stops the test,
+ * so that a change to dsp_transform.dsp can't silently go unchecked. The
+ * model follows the SCU manual:
+ *
+ *   - Every bus of an operation reads the registers as they were at the
+ *     start of the cycle. ALU results are available to MOV ALU,A and to
+ *     ALL/ALH in the same cycle
+ *   - MOV MUL,P takes the 48-bit product of RX and RY
+ *   - Reading MCn, or writing to it, increments CTn once per cycle, unless
+ *     CTn is written to in the same cycle
+ *   - JMP and BTM have a delay slot
+ *   - DMA transfers are complete by the next cycle, so T0 is never set.
+ *     Reads step D0 by the add mode in longs, and writes by half of it */
+
+/* Matches dsp_transform.c */
+#define PARAMS_OFFSET   13
+#define ONE_OFFSET      3
+#define ONE             0x00010000
+
+#define BATCH_COUNT     21
+
+/* Points and translations within +/-2048 units in 22.10, as in mic3d */
+#define COORD_MAX       (2048 << 10)
+
+/* 18.14, as in mic3d */
+#define MATRIX_SHIFT    14
+
+#define STEP_COUNT_MAX  4096
+
+/* Longs of work RAM reachable through D0. The input is at IN_ADDRESS and the
+ * output at OUT_ADDRESS */
+#define MEMORY_SIZE     1024
+#define IN_ADDRESS      0x06010000
+#define OUT_ADDRESS     0x06010800
+
+#define MASK_48         ((UINT64_C(1) << 48) - 1)
+
+static const uint32_t _program[] = {
+#include "../dsp_transform.inc"
+};
+
+typedef struct {
+        uint32_t ram[4][64];
+        uint8_t ct[4];
+
+        int32_t rx;
+        int32_t ry;
+        int64_t p;
+        int64_t a;
+
+        uint32_t ra0;
+        uint32_t wa0;
+        uint32_t lop;
+        uint8_t top;
+} dsp_t;
+
+static uint32_t _memory[MEMORY_SIZE];
+
+static uint32_t _seed = 0x12345678;
+
+/* Only the first mismatch is printed */
+static bool _mismatch_printed = false;
+
+static bool _run(dsp_t *);
+static bool _op_run(dsp_t *, uint32_t);
+static bool _dma_run(dsp_t *, uint32_t);
+static uint32_t *_memory_get(uint32_t);
+
+static int64_t _sign_extend_48(uint64_t);
+static int32_t _random_get(int32_t, int32_t);
+
+static uint32_t _batch_check(const int32_t [3][4], const int32_t [3][4],
+    uint32_t, bool);
+
+int
+main(int argc, char *argv[])
+{
+        uint32_t batch_count;
+        batch_count = 10000;
+
+        if (argc > 1) {
+                batch_count = strtoul(argv[1], NULL, 0);
+        }
+
+        uint32_t mismatch_count;
+        mismatch_count = 0;
+
+        uint32_t point_count;
+        point_count = 0;
+
+        /* The rotation used by scu-dsp-transform, in 16.16 */
+        const int32_t example[3][4] = {
+                {  0x0000DDB4,          0, 0x00008000, 10 << 10 },
+                {           0, 0x00010000,          0, -(5 << 10) },
+                { -0x00008000,          0, 0x0000DDB4, 200 << 10 }
+        };
+
+        mismatch_count += _batch_check(example, NULL, BATCH_COUNT, false);
+        point_count += BATCH_COUNT;
+
+        uint32_t i;
+
+        for (i = 0; i < batch_count; i++) {
+                /* Any 18.14 element and 22.10 translation mic3d can have,
+                 * passed to the DSP as mic3d does */
+                int32_t matrix[3][4];
+                int32_t dsp_matrix[3][4];
+
+                uint32_t row;
+
+                for (row = 0; row < 3; row++) {
+                        uint32_t column;
+
+                        for (column = 0; column < 3; column++) {
+                                matrix[row][column] = _random_get(-(1 << MATRIX_SHIFT), 1 << MATRIX_SHIFT);
+                                dsp_matrix[row][column] = matrix[row][column] << (16 - MATRIX_SHIFT);
+                        }
+
+                        matrix[row][3] = _random_get(-COORD_MAX, COORD_MAX);
+                        dsp_matrix[row][3] = matrix[row][3];
+                }
+
+                const uint32_t count = 1 + (i % BATCH_COUNT);
+
+                mismatch_count += _batch_check(dsp_matrix, matrix, count, true);
+                point_count += count;
+        }
+
+        printf("%u batches, %u points: %u mismatches\n",
+            batch_count + 1, point_count, mismatch_count);
+
+        return (mismatch_count == 0) ? 0 : 1;
+}
+
+/* Transforms a batch of random points with the DSP matrix, and compares the
+ * result with the generic 16.16 transform. When a mic3d matrix is given,
+ * also compares it with mic3d's own transform */
+static uint32_t
+_batch_check(const int32_t dsp_matrix[3][4], const int32_t matrix[3][4],
+    uint32_t count, bool random_points)
+{
+        dsp_t dsp;
+
+        (void)memset(&dsp, 0x00, sizeof(dsp));
+        (void)memset(_memory, 0x00, sizeof(_memory));
+
+        /* Same writes as dsp_transform_matrix_set() and
+         * dsp_transform_batch_start() */
+        uint32_t i;
+
+        for (i = 0; i < 12; i++) {
+                dsp.ram[0][i] = (uint32_t)dsp_matrix[i / 4][i % 4];
+        }
+
+        dsp.ram[3][ONE_OFFSET] = ONE;
+
+        dsp.ram[0][PARAMS_OFFSET + 0] = (IN_ADDRESS & 0x07FFFFFF) >> 2;
+        dsp.ram[0][PARAMS_OFFSET + 1] = (OUT_ADDRESS & 0x07FFFFFF) >> 2;
+        dsp.ram[0][PARAMS_OFFSET + 2] = count * 3;
+        dsp.ram[0][PARAMS_OFFSET + 3] = count - 1;
+
+        int32_t points[BATCH_COUNT][3];
+
+        for (i = 0; i < count; i++) {
+                uint32_t j;
+
+                for (j = 0; j < 3; j++) {
+                        points[i][j] = (random_points)
+                            ? _random_get(-COORD_MAX, COORD_MAX)
+                            : _random_get(-(256 << 10), 256 << 10);
+
+                        *_memory_get(((IN_ADDRESS & 0x07FFFFFF) >> 2) + (i * 3) + j) =
+                            (uint32_t)points[i][j];
+                }
+        }
+
+        /* Canary past the last point */
+        *_memory_get(((OUT_ADDRESS & 0x07FFFFFF) >> 2) + (count * 3)) = 0xDEADBEEF;
+
+        if (!_run(&dsp)) {
+                exit(1);
+        }
+
+        uint32_t mismatch_count;
+        mismatch_count = 0;
+
+        if (*_memory_get(((OUT_ADDRESS & 0x07FFFFFF) >> 2) + (count * 3)) != 0xDEADBEEF) {
+                fprintf(stderr, "Wrote past the last point\n");
+
+                mismatch_count++;
+        }
+
+        for (i = 0; i < count; i++) {
+                uint32_t row;
+
+                for (row = 0; row < 3; row++) {
+                        const int32_t * const m = dsp_matrix[row];
+
+                        const int32_t out =
+                            (int32_t)*_memory_get(((OUT_ADDRESS & 0x07FFFFFF) >> 2) + (i * 3) + row);
+
+                        const int64_t sum =
+                            ((int64_t)m[0] * points[i][0]) +
+                            ((int64_t)m[1] * points[i][1]) +
+                            ((int64_t)m[2] * points[i][2]) +
+                            ((int64_t)m[3] * ONE);
+
+                        bool mismatch;
+                        mismatch = (out != (int32_t)(sum >> 16));
+
+                        if (matrix != NULL) {
+                                /* _matrix_row_dot() plus the translation */
+                                const int64_t row_sum =
+                                    ((int64_t)points[i][0] * matrix[row][0]) +
+                                    ((int64_t)points[i][1] * matrix[row][1]) +
+                                    ((int64_t)points[i][2] * matrix[row][2]);
+
+                                mismatch |= (out != ((int32_t)(row_sum >> MATRIX_SHIFT) + matrix[row][3]));
+                        }
+
+                        if (mismatch) {
+                                if (!_mismatch_printed) {
+                                        fprintf(stderr, "Point %u, row %u: %08X, expected %08X\n",
+                                            i, row, (uint32_t)out, (uint32_t)(sum >> 16));
+
+                                        _mismatch_printed = true;
+                                }
+
+                                mismatch_count++;
+                        }
+                }
+        }
+
+        return mismatch_count;
+}
+
+static bool
+_run(dsp_t *dsp)
+{
+        const uint32_t program_count = sizeof(_program) / sizeof(*_program);
+
+        uint32_t pc;
+        pc = 0;
+
+        /* Taken jump waiting on its delay slot, or -1 */
+        int32_t jump_pc;
+        jump_pc = -1;
+
+        uint32_t step;
+
+        for (step = 0; step < STEP_COUNT_MAX; step++) {
+                if (pc >= program_count) {
+                        fprintf(stderr, "%02X: Ran past the end of the program\n", pc);
+
+                        return false;
+                }
+
+                const uint32_t opcode = _program[pc];
+
+                uint32_t next_pc;
+                next_pc = pc + 1;
+
+                if (jump_pc >= 0) {
+                        next_pc = jump_pc;
+                        jump_pc = -1;
+                }
+
+                switch (opcode >> 28) {
+                case 0x0:
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                        if (!_op_run(dsp, opcode)) {
+                                fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                                return false;
+                        }
+                        break;
+                case 0xC:
+                        if (!_dma_run(dsp, opcode)) {
+                                fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                                return false;
+                        }
+                        break;
+                case 0xD:
+                        /* Only JMP T0, which is never taken, and JMP */
+                        if ((opcode & 0x03F80000) == 0x03400000) {
+                                break;
+                        }
+
+                        if ((opcode & 0x03F80000) != 0x00000000) {
+                                fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                                return false;
+                        }
+
+                        jump_pc = opcode & 0xFF;
+                        break;
+                case 0xE:
+                        if (opcode != 0xE0000000) {
+                                fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                                return false;
+                        }
+
+                        /* BTM */
+                        if (dsp->lop != 0) {
+                                dsp->lop = (dsp->lop - 1) & 0x0FFF;
+
+                                jump_pc = dsp->top;
+                        }
+                        break;
+                case 0xF:
+                        /* END and ENDI */
+                        if ((opcode == 0xF0000000) || (opcode == 0xF8000000)) {
+                                return true;
+                        }
+
+                        fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                        return false;
+                default:
+                        fprintf(stderr, "%02X: %08X isn't modelled\n", pc, opcode);
+
+                        return false;
+                }
+
+                pc = next_pc;
+        }
+
+        fprintf(stderr, "Didn't end within %u steps\n", STEP_COUNT_MAX);
+
+        return false;
+}
+
+static bool
+_op_run(dsp_t *dsp, uint32_t opcode)
+{
+        const uint32_t alu_op = (opcode >> 26) & 0x0F;
+        const uint32_t x_op = (opcode >> 23) & 0x07;
+        const uint32_t x_source = (opcode >> 20) & 0x07;
+        const uint32_t y_op = (opcode >> 17) & 0x07;
+        const uint32_t y_source = (opcode >> 14) & 0x07;
+        const uint32_t d1_op = (opcode >> 12) & 0x03;
+        const uint32_t d1_destination = (opcode >> 8) & 0x0F;
+        const uint32_t d1_source = opcode & 0xFF;
+
+        bool increments[4] = {
+                false, false, false, false
+        };
+
+        int64_t alu;
+
+        switch (alu_op) {
+        case 0x0:
+                alu = dsp->a;
+                break;
+        case 0x6:
+                /* AD2 */
+                alu = _sign_extend_48((uint64_t)(dsp->a + dsp->p) & MASK_48);
+                break;
+        default:
+                return false;
+        }
+
+        int32_t rx;
+        rx = dsp->rx;
+
+        int32_t ry;
+        ry = dsp->ry;
+
+        int64_t p;
+        p = dsp->p;
+
+        int64_t a;
+        a = dsp->a;
+
+        /* X-bus: MOV [s],X in bit 2, and MOV MUL,P (2) in bits 1-0 */
+        if ((x_op & 0x4) != 0) {
+                rx = dsp->ram[x_source & 3][dsp->ct[x_source & 3]];
+                increments[x_source & 3] |= ((x_source & 4) != 0);
+        }
+
+        switch (x_op & 0x3) {
+        case 0x0:
+                break;
+        case 0x2:
+                p = _sign_extend_48((uint64_t)((int64_t)dsp->rx * dsp->ry) & MASK_48);
+                break;
+        default:
+                return false;
+        }
+
+        /* Y-bus: MOV [s],Y in bit 2, and CLR A (1) or MOV ALU,A (2) in
+         * bits 1-0 */
+        if ((y_op & 0x4) != 0) {
+                ry = dsp->ram[y_source & 3][dsp->ct[y_source & 3]];
+                increments[y_source & 3] |= ((y_source & 4) != 0);
+        }
+
+        switch (y_op & 0x3) {
+        case 0x0:
+                break;
+        case 0x1:
+                a = 0;
+                break;
+        case 0x2:
+                a = alu;
+                break;
+        default:
+                return false;
+        }
+
+        bool ct_written[4] = {
+                false, false, false, false
+        };
+
+        if (d1_op != 0) {
+                uint32_t value;
+
+                if (d1_op == 0x1) {
+                        value = (uint32_t)(int32_t)(int8_t)d1_source;
+                } else if (d1_op == 0x3) {
+                        if (d1_source < 8) {
+                                value = dsp->ram[d1_source & 3][dsp->ct[d1_source & 3]];
+                                increments[d1_source & 3] |= ((d1_source & 4) != 0);
+                        } else if (d1_source == 0x9) {
+                                value = (uint32_t)alu;
+                        } else if (d1_source == 0xA) {
+                                value = (uint32_t)(alu >> 16);
+                        } else {
+                                return false;
+                        }
+                } else {
+                        return false;
+                }
+
+                switch (d1_destination) {
+                case 0x0:
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                        dsp->ram[d1_destination][dsp->ct[d1_destination]] = value;
+                        increments[d1_destination] = true;
+                        break;
+                case 0x6:
+                        dsp->ra0 = value;
+                        break;
+                case 0x7:
+                        dsp->wa0 = value;
+                        break;
+                case 0xA:
+                        dsp->lop = value & 0x0FFF;
+                        break;
+                case 0xB:
+                        dsp->top = value & 0xFF;
+                        break;
+                case 0xC:
+                case 0xD:
+                case 0xE:
+                case 0xF:
+                        dsp->ct[d1_destination & 3] = value & 0x3F;
+                        ct_written[d1_destination & 3] = true;
+                        break;
+                default:
+                        return false;
+                }
+        }
+
+        uint32_t i;
+
+        for (i = 0; i < 4; i++) {
+                if (increments[i] && !ct_written[i]) {
+                        dsp->ct[i] = (dsp->ct[i] + 1) & 0x3F;
+                }
+        }
+
+        dsp->rx = rx;
+        dsp->ry = ry;
+        dsp->p = p;
+        dsp->a = a;
+
+        return true;
+}
+
+static bool
+_dma_run(dsp_t *dsp, uint32_t opcode)
+{
+        static const uint32_t add_values[] = {
+                0, 1, 2, 4, 8, 16, 32, 64
+        };
+
+        const uint32_t add = add_values[(opcode >> 15) & 0x07];
+        const bool hold = ((opcode & (1 << 14)) != 0);
+        const bool to_d0 = ((opcode & (1 << 12)) != 0);
+        const uint32_t ram = (opcode >> 8) & 0x07;
+
+        if (hold || (ram > 3)) {
+                return false;
+        }
+
+        uint32_t count;
+
+        if ((opcode & (1 << 13)) != 0) {
+                const uint32_t source = opcode & 0x07;
+
+                count = dsp->ram[source & 3][dsp->ct[source & 3]];
+
+                if ((source & 4) != 0) {
+                        dsp->ct[source & 3] = (dsp->ct[source & 3] + 1) & 0x3F;
+                }
+        } else {
+                count = opcode & 0xFF;
+        }
+
+        uint32_t i;
+
+        for (i = 0; i < count; i++) {
+                if (to_d0) {
+                        *_memory_get(dsp->wa0) = dsp->ram[ram][dsp->ct[ram]];
+                        dsp->wa0 += add / 2;
+                } else {
+                        dsp->ram[ram][dsp->ct[ram]] = *_memory_get(dsp->ra0);
+                        dsp->ra0 += add;
+                }
+
+                dsp->ct[ram] = (dsp->ct[ram] + 1) & 0x3F;
+        }
+
+        return true;
+}
+
+static uint32_t *
+_memory_get(uint32_t address)
+{
+        const uint32_t base = (IN_ADDRESS & 0x07FFFFFF) >> 2;
+
+        if ((address < base) || (address >= (base + MEMORY_SIZE))) {
+                fprintf(stderr, "D0 address 0x%08X is out of range\n", address << 2);
+
+                exit(1);
+        }
+
+        return &_memory[address - base];
+}
+
+static int64_t
+_sign_extend_48(uint64_t value)
+{
+        if ((value & (UINT64_C(1) << 47)) != 0) {
+                value |= ~MASK_48;
+        }
+
+        return (int64_t)value;
+}
+
+/* In [min, max] */
+static int32_t
+_random_get(int32_t min, int32_t max)
+{
+        _seed = (_seed * 1103515245) + 12345;
+
+        const uint32_t range = (uint32_t)(max - min) + 1;
+
+        return min + (int32_t)((((uint64_t)_seed << 16) ^ (_seed >> 8)) % range);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <string.h>
+
+#include "depth_sort.h"
+
+static void _insertion_sort(depth_sort_entry_t *, uint32_t);
+static void _offsets_build(uint32_t *);
+static void _scatter(const depth_sort_entry_t *, depth_sort_entry_t *,
+    uint32_t *, uint32_t, uint32_t);
+
+void
+depth_sort(depth_sort_entry_t *entries, depth_sort_entry_t *scratch,
+    uint32_t count)
+{
+        if (count <= DEPTH_SORT_INSERTION_COUNT_MAX) {
+                _insertion_sort(entries, count);
+
+                return;
+        }
+
+        uint32_t offsets_lo[256];
+        uint32_t offsets_hi[256];
+
+        (void)memset(offsets_lo, 0, sizeof(offsets_lo));
+        (void)memset(offsets_hi, 0, sizeof(offsets_hi));
+
+        /* Histogram both key bytes in a single pass */
+        uint32_t i;
+
+        for (i = 0; i < count; i++) {
+                const depth_sort_entry_t entry = entries[i];
+
+                offsets_lo[(entry >> 16) & 0xFF]++;
+                offsets_hi[entry >> 24]++;
+        }
+
+        _offsets_build(offsets_lo);
+        _offsets_build(offsets_hi);
+
+        _scatter(entries, scratch, offsets_lo, 16, count);
+        _scatter(scratch, entries, offsets_hi, 24, count);
+}
+
+/* Only moves an entry past ones with strictly lower keys, so it's stable */
+static void
+_insertion_sort(depth_sort_entry_t *entries, uint32_t count)
+{
+        uint32_t i;
+
+        for (i = 1; i < count; i++) {
+                const depth_sort_entry_t entry = entries[i];
+                const uint16_t key = DEPTH_SORT_ENTRY_KEY(entry);
+
+                uint32_t j;
+
+                for (j = i; j > 0; j--) {
+                        if (DEPTH_SORT_ENTRY_KEY(entries[j - 1]) >= key) {
+                                break;
+                        }
+
+                        entries[j] = entries[j - 1];
+                }
+
+                entries[j] = entry;
+        }
+}
+
+/* Turns a histogram into the starting offset of each bucket. Buckets are laid
+ * out from the highest to the lowest, which gives a descending order */
+static void
+_offsets_build(uint32_t *histogram)
+{
+        uint32_t offset;
+        offset = 0;
+
+        int32_t bucket;
+
+        for (bucket = 255; bucket >= 0; bucket--) {
+                const uint32_t bucket_count = histogram[bucket];
+
+                histogram[bucket] = offset;
+
+                offset += bucket_count;
+        }
+}
+
+static void
+_scatter(const depth_sort_entry_t *in, depth_sort_entry_t *out,
+    uint32_t *offsets, uint32_t shift, uint32_t count)
+{
+        uint32_t i;
+
+        for (i = 0; i < count; i++) {
+                const depth_sort_entry_t entry = in[i];
+
+                out[offsets[(entry >> shift) & 0xFF]++] = entry;
+        }
+}
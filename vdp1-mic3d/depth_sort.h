@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef _DEPTH_SORT_H
+#define _DEPTH_SORT_H
+
+#include <stdint.h>
+
+/* An entry packs a 16-bit depth key (upper half) with the index of the
+ * element being sorted (lower half), so that only one word moves around per
+ * element */
+typedef uint32_t depth_sort_entry_t;
+
+#define DEPTH_SORT_ENTRY(key, index)                                           \
+        ((depth_sort_entry_t)(((uint32_t)(key) << 16) | ((index) & 0xFFFF)))
+
+#define DEPTH_SORT_ENTRY_KEY(entry)     ((uint16_t)((entry) >> 16))
+#define DEPTH_SORT_ENTRY_INDEX(entry)   ((uint16_t)((entry) & 0xFFFF))
+
+#define DEPTH_SORT_INDEX_MAX            0xFFFF
+
+/* Converts a signed depth to a key that sorts in the same order. The depth is
+ * scaled down by shift bits and clamped to 16 bits */
+static inline uint16_t
+depth_sort_key(int32_t depth, uint32_t shift)
+{
+        int32_t key;
+        key = depth >> shift;
+
+        if (key < INT16_MIN) {
+                key = INT16_MIN;
+        } else if (key > INT16_MAX) {
+                key = INT16_MAX;
+        }
+
+        return (uint16_t)(key - INT16_MIN);
+}
+
+/* Below this count, clearing and walking the two 256 bucket histograms costs
+ * more than an insertion sort (between 32 and 47 entries in host/bench) */
+#define DEPTH_SORT_INSERTION_COUNT_MAX  32
+
+/* Sorts entries back to front (descending keys) with a two pass, 8-bit radix
+ * sort, or an insertion sort for small counts. Entries with equal keys keep
+ * their order. The scratch buffer must be able to hold count entries */
+void depth_sort(depth_sort_entry_t *entries, depth_sort_entry_t *scratch,
+    uint32_t count);
+
+#endif /* _DEPTH_SORT_H */
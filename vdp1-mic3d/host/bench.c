@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "depth_sort.h"
+
+#define DEPTH_SORT_SHIFT 4
+
+/* Roughly the same amount of sorting work per face count */
+#define FACES_PER_RUN 2000000
+
+static const uint32_t _default_face_counts[] = {
+        47,
+        500,
+        5000
+};
+
+static uint32_t _seed = 1;
+
+static int32_t *_depths;
+static int32_t *_avg_z;
+static int32_t *_order;
+
+static depth_sort_entry_t *_entries;
+static depth_sort_entry_t *_scratch;
+
+static void _depths_generate(uint32_t);
+
+static void _bubble_sort(uint32_t);
+static void _radix_sort(uint32_t);
+
+static bool _radix_sort_check(uint32_t);
+
+static double _time(void (*)(uint32_t), uint32_t, uint32_t);
+static double _time_get(void);
+
+int
+main(int argc, char *argv[])
+{
+        const uint32_t *face_counts;
+        face_counts = _default_face_counts;
+
+        uint32_t face_count_count;
+        face_count_count = sizeof(_default_face_counts) / sizeof(*_default_face_counts);
+
+        uint32_t *arg_face_counts;
+        arg_face_counts = NULL;
+
+        if (argc > 1) {
+                face_count_count = argc - 1;
+
+                arg_face_counts = malloc(face_count_count * sizeof(uint32_t));
+                assert(arg_face_counts != NULL);
+
+                uint32_t i;
+
+                for (i = 0; i < face_count_count; i++) {
+                        arg_face_counts[i] = strtoul(argv[i + 1], NULL, 0);
+
+                        if ((arg_face_counts[i] == 0) ||
+                            (arg_face_counts[i] > (DEPTH_SORT_INDEX_MAX + 1))) {
+                                fprintf(stderr, "Invalid face count: %s\n", argv[i + 1]);
+
+                                return 1;
+                        }
+                }
+
+                face_counts = arg_face_counts;
+        }
+
+        printf("%8s %10s %12s %12s %8s\n",
+            "faces", "runs", "bubble us", "sort us", "speedup");
+
+        uint32_t i;
+
+        for (i = 0; i < face_count_count; i++) {
+                const uint32_t face_count = face_counts[i];
+
+                _depths = malloc(face_count * sizeof(int32_t));
+                _avg_z = malloc(face_count * sizeof(int32_t));
+                _order = malloc(face_count * sizeof(int32_t));
+                _entries = malloc(face_count * sizeof(depth_sort_entry_t));
+                _scratch = malloc(face_count * sizeof(depth_sort_entry_t));
+
+                assert((_depths != NULL) && (_avg_z != NULL) && (_order != NULL));
+                assert((_entries != NULL) && (_scratch != NULL));
+
+                _depths_generate(face_count);
+
+                _radix_sort(face_count);
+
+                if (!_radix_sort_check(face_count)) {
+                        fprintf(stderr, "Radix sort mismatch with %u faces\n", face_count);
+
+                        return 1;
+                }
+
+                uint32_t run_count;
+                run_count = FACES_PER_RUN / face_count;
+
+                /* The bubble sort is quadratic, so cap its runs */
+                uint32_t bubble_run_count;
+                bubble_run_count = (run_count * 47) / face_count;
+                bubble_run_count = (bubble_run_count == 0) ? 1 : bubble_run_count;
+                bubble_run_count = (bubble_run_count > run_count) ? run_count : bubble_run_count;
+
+                const double bubble_time = _time(_bubble_sort, face_count, bubble_run_count);
+                const double radix_time = _time(_radix_sort, face_count, run_count);
+
+                printf("%8u %10u %12.3f %12.3f %7.1fx\n",
+                    face_count,
+                    run_count,
+                    bubble_time * 1e6,
+                    radix_time * 1e6,
+                    bubble_time / radix_time);
+
+                free(_scratch);
+                free(_entries);
+                free(_order);
+                free(_avg_z);
+                free(_depths);
+        }
+
+        free(arg_face_counts);
+
+        return 0;
+}
+
+/* Sums of 4 Z values in 22.10, over the range the logo covers */
+static void
+_depths_generate(uint32_t face_count)
+{
+        uint32_t i;
+
+        for (i = 0; i < face_count; i++) {
+                _seed = (_seed * 1103515245) + 12345;
+
+                _depths[i] = (int32_t)((_seed >> 8) % (4 * 2 * 53248)) - (4 * 53248);
+        }
+}
+
+/* The sort vdp1-mic3d.c used to have */
+static void
+_bubble_sort(uint32_t n)
+{
+        uint32_t i;
+        uint32_t j;
+        int32_t tmp;
+
+        for (i = 0; i < n; i++) {
+                _avg_z[i] = _depths[i];
+                _order[i] = i;
+        }
+
+        for (i = 0; i < (n - 1); i++) {
+                for (j = i + 1; j < n; j++) {
+                        if (_avg_z[j] > _avg_z[i]) {
+                                tmp = _avg_z[i];
+                                _avg_z[i] = _avg_z[j];
+                                _avg_z[j] = tmp;
+                                tmp = _order[i];
+                                _order[i] = _order[j];
+                                _order[j] = tmp;
+                        }
+                }
+        }
+}
+
+static void
+_radix_sort(uint32_t n)
+{
+        uint32_t i;
+
+        for (i = 0; i < n; i++) {
+                _entries[i] = DEPTH_SORT_ENTRY(
+                        depth_sort_key(_depths[i], DEPTH_SORT_SHIFT), i);
+        }
+
+        depth_sort(_entries, _scratch, n);
+}
+
+/* Keys must be descending, equal keys must keep their order, and every face
+ * must come out exactly once */
+static bool
+_radix_sort_check(uint32_t n)
+{
+        bool *seen;
+        seen = calloc(n, sizeof(bool));
+        assert(seen != NULL);
+
+        bool valid;
+        valid = true;
+
+        uint32_t i;
+
+        for (i = 0; valid && (i < n); i++) {
+                const uint32_t index = DEPTH_SORT_ENTRY_INDEX(_entries[i]);
+                const uint16_t key = DEPTH_SORT_ENTRY_KEY(_entries[i]);
+
+                valid = (index < n) && !seen[index] &&
+                        (key == depth_sort_key(_depths[index], DEPTH_SORT_SHIFT));
+
+                if (valid && (i > 0)) {
+                        const uint16_t prev_key = DEPTH_SORT_ENTRY_KEY(_entries[i - 1]);
+                        const uint32_t prev_index = DEPTH_SORT_ENTRY_INDEX(_entries[i - 1]);
+
+                        valid = (prev_key > key) ||
+                                ((prev_key == key) && (prev_index < index));
+                }
+
+                if (valid) {
+                        seen[index] = true;
+                }
+        }
+
+        free(seen);
+
+        return valid;
+}
+
+/* Average time per sort, in seconds */
+static double
+_time(void (*sort)(uint32_t), uint32_t face_count, uint32_t run_count)
+{
+        const double start_time = _time_get();
+
+        uint32_t run;
+
+        for (run = 0; run < run_count; run++) {
+                sort(face_count);
+        }
+
+        return (_time_get() - start_time) / run_count;
+}
+
+static double
+_time_get(void)
+{
+        struct timespec ts;
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
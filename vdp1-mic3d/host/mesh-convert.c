@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mesh.h"
+
+/* Converts the vertices and faces of a Wavefront OBJ file into a binary mesh
+ * (see mesh.h). Everything else in the OBJ file is ignored.
+ *
+ *   mesh-convert [-s scale] [-d] input.obj output.msh
+ *
+ * Vertices are multiplied by scale, then stored in 22.10. Faces must have 3
+ * or 4 vertices, and their normals are computed here. With -d, every face is
+ * double-sided */
+
+#define POINT_COUNT_MAX 0xFFFF
+#define FACE_COUNT_MAX  0xFFFF
+
+typedef struct {
+        mesh_point_t points[POINT_COUNT_MAX];
+        mesh_face_t faces[FACE_COUNT_MAX];
+        mesh_normal_t normals[FACE_COUNT_MAX];
+
+        uint32_t point_count;
+        uint32_t face_count;
+} obj_t;
+
+static obj_t _obj;
+
+static bool _obj_read(const char *, double, uint16_t);
+static bool _face_parse(char *, uint32_t, mesh_face_t *);
+static void _face_normal_calculate(const mesh_face_t *, mesh_normal_t *);
+
+static int32_t _radius_calculate(void);
+
+static bool _mesh_write(const char *);
+
+static void _write16(FILE *, uint16_t);
+static void _write32(FILE *, uint32_t);
+
+static void
+_usage(const char *program)
+{
+        fprintf(stderr, "Usage: %s [-s scale] [-d] input output\n", program);
+}
+
+int
+main(int argc, char *argv[])
+{
+        double scale;
+        scale = 1.0;
+
+        uint16_t face_flags;
+        face_flags = 0x0000;
+
+        int opt;
+
+        while ((opt = getopt(argc, argv, "s:d")) != -1) {
+                switch (opt) {
+                case 's':
+                        scale = strtod(optarg, NULL);
+                        break;
+                case 'd':
+                        face_flags |= MESH_FACE_DOUBLE_SIDED;
+                        break;
+                default:
+                        _usage(argv[0]);
+
+                        return 1;
+                }
+        }
+
+        if ((argc - optind) != 2) {
+                _usage(argv[0]);
+
+                return 1;
+        }
+
+        const char * const input_path = argv[optind];
+        const char * const output_path = argv[optind + 1];
+
+        if (!_obj_read(input_path, scale, face_flags)) {
+                return 1;
+        }
+
+        if (!_mesh_write(output_path)) {
+                fprintf(stderr, "Unable to write %s\n", output_path);
+
+                return 1;
+        }
+
+        printf("%s: %u points, %u faces\n", output_path,
+            _obj.point_count, _obj.face_count);
+
+        return 0;
+}
+
+static bool
+_obj_read(const char *path, double scale, uint16_t face_flags)
+{
+        FILE * const fp = fopen(path, "r");
+
+        if (fp == NULL) {
+                fprintf(stderr, "Unable to open %s\n", path);
+
+                return false;
+        }
+
+        char line[512];
+        uint32_t line_number;
+        line_number = 0;
+
+        bool valid;
+        valid = true;
+
+        while (valid && (fgets(line, sizeof(line), fp) != NULL)) {
+                line_number++;
+
+                if (strncmp(line, "v ", 2) == 0) {
+                        double x;
+                        double y;
+                        double z;
+
+                        if ((sscanf(&line[2], "%lf %lf %lf", &x, &y, &z)) != 3) {
+                                fprintf(stderr, "%s:%u: Invalid vertex\n", path, line_number);
+
+                                valid = false;
+                        } else if (_obj.point_count == POINT_COUNT_MAX) {
+                                fprintf(stderr, "%s:%u: Too many vertices\n", path, line_number);
+
+                                valid = false;
+                        } else {
+                                mesh_point_t * const point = &_obj.points[_obj.point_count];
+
+                                point->x = lround(x * scale * 1024.0);
+                                point->y = lround(y * scale * 1024.0);
+                                point->z = lround(z * scale * 1024.0);
+
+                                if ((labs(point->x) > MESH_COORD_MAX) ||
+                                    (labs(point->y) > MESH_COORD_MAX) ||
+                                    (labs(point->z) > MESH_COORD_MAX)) {
+                                        fprintf(stderr, "%s:%u: Vertex out of range\n", path, line_number);
+
+                                        valid = false;
+                                }
+
+                                _obj.point_count++;
+                        }
+                } else if (strncmp(line, "f ", 2) == 0) {
+                        mesh_face_t * const face = &_obj.faces[_obj.face_count];
+
+                        if (_obj.face_count == FACE_COUNT_MAX) {
+                                fprintf(stderr, "%s:%u: Too many faces\n", path, line_number);
+
+                                valid = false;
+                        } else if (!_face_parse(&line[2], _obj.point_count, face)) {
+                                fprintf(stderr, "%s:%u: Invalid face\n", path, line_number);
+
+                                valid = false;
+                        } else {
+                                face->flags = face_flags;
+                                face->reserved = 0x0000;
+
+                                _face_normal_calculate(face, &_obj.normals[_obj.face_count]);
+
+                                _obj.face_count++;
+                        }
+                }
+        }
+
+        (void)fclose(fp);
+
+        return valid;
+}
+
+/* Faces may only refer to vertices defined before them */
+static bool
+_face_parse(char *s, uint32_t point_count, mesh_face_t *face)
+{
+        uint16_t indices[4];
+        uint32_t count;
+        count = 0;
+
+        char *saveptr;
+        char *token;
+
+        for (token = strtok_r(s, " \t\r\n", &saveptr);
+             token != NULL;
+             token = strtok_r(NULL, " \t\r\n", &saveptr)) {
+                if (count == 4) {
+                        return false;
+                }
+
+                /* Texture and normal indices are ignored */
+                long index;
+                index = strtol(token, NULL, 10);
+
+                /* Negative indices are relative to the last vertex */
+                if (index < 0) {
+                        index += point_count + 1;
+                }
+
+                if ((index < 1) || ((uint32_t)index > point_count)) {
+                        return false;
+                }
+
+                indices[count] = index - 1;
+
+                count++;
+        }
+
+        if (count < 3) {
+                return false;
+        }
+
+        face->p0 = indices[0];
+        face->p1 = indices[1];
+        face->p2 = indices[2];
+        face->p3 = (count == 4) ? indices[3] : indices[2];
+
+        return true;
+}
+
+/* Newell's method, so that quads that aren't quite planar still get an
+ * averaged normal. Faces with no area get a zero normal */
+static void
+_face_normal_calculate(const mesh_face_t *face, mesh_normal_t *normal)
+{
+        const uint16_t indices[4] = {
+                face->p0,
+                face->p1,
+                face->p2,
+                face->p3
+        };
+
+        double n[3] = {
+                0.0,
+                0.0,
+                0.0
+        };
+
+        uint32_t i;
+
+        for (i = 0; i < 4; i++) {
+                const mesh_point_t * const a = &_obj.points[indices[i]];
+                const mesh_point_t * const b = &_obj.points[indices[(i + 1) & 3]];
+
+                n[0] += (double)(a->y - b->y) * (double)(a->z + b->z);
+                n[1] += (double)(a->z - b->z) * (double)(a->x + b->x);
+                n[2] += (double)(a->x - b->x) * (double)(a->y + b->y);
+        }
+
+        const double length = sqrt((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]));
+
+        normal->reserved = 0;
+
+        if (length == 0.0) {
+                normal->x = 0;
+                normal->y = 0;
+                normal->z = 0;
+
+                return;
+        }
+
+        normal->x = lround((n[0] / length) * 1024.0);
+        normal->y = lround((n[1] / length) * 1024.0);
+        normal->z = lround((n[2] / length) * 1024.0);
+}
+
+/* Rounded up, so that every point is inside */
+static int32_t
+_radius_calculate(void)
+{
+        double radius_squared;
+        radius_squared = 0.0;
+
+        uint32_t i;
+
+        for (i = 0; i < _obj.point_count; i++) {
+                const mesh_point_t * const point = &_obj.points[i];
+
+                const double x = point->x;
+                const double y = point->y;
+                const double z = point->z;
+
+                const double length_squared = (x * x) + (y * y) + (z * z);
+
+                if (length_squared > radius_squared) {
+                        radius_squared = length_squared;
+                }
+        }
+
+        return ceil(sqrt(radius_squared));
+}
+
+static bool
+_mesh_write(const char *path)
+{
+        FILE * const fp = fopen(path, "wb");
+
+        if (fp == NULL) {
+                return false;
+        }
+
+        const uint32_t points_offset = sizeof(mesh_t);
+        const uint32_t faces_offset = points_offset +
+            (_obj.point_count * sizeof(mesh_point_t));
+        const uint32_t normals_offset = faces_offset +
+            (_obj.face_count * sizeof(mesh_face_t));
+
+        (void)fwrite(MESH_SIGNATURE, 1, 4, fp);
+        _write16(fp, MESH_VERSION);
+        _write16(fp, 0x0000);
+        _write16(fp, _obj.point_count);
+        _write16(fp, _obj.face_count);
+        _write32(fp, points_offset);
+        _write32(fp, faces_offset);
+        _write32(fp, normals_offset);
+        _write32(fp, _radius_calculate());
+
+        uint32_t i;
+
+        for (i = 0; i < _obj.point_count; i++) {
+                _write32(fp, _obj.points[i].x);
+                _write32(fp, _obj.points[i].y);
+                _write32(fp, _obj.points[i].z);
+        }
+
+        for (i = 0; i < _obj.face_count; i++) {
+                _write16(fp, _obj.faces[i].p0);
+                _write16(fp, _obj.faces[i].p1);
+                _write16(fp, _obj.faces[i].p2);
+                _write16(fp, _obj.faces[i].p3);
+                _write16(fp, _obj.faces[i].flags);
+                _write16(fp, _obj.faces[i].reserved);
+        }
+
+        for (i = 0; i < _obj.face_count; i++) {
+                _write16(fp, _obj.normals[i].x);
+                _write16(fp, _obj.normals[i].y);
+                _write16(fp, _obj.normals[i].z);
+                _write16(fp, _obj.normals[i].reserved);
+        }
+
+        const bool written = (ferror(fp) == 0);
+
+        return ((fclose(fp) == 0) && written);
+}
+
+static void
+_write16(FILE *fp, uint16_t value)
+{
+        (void)fputc(value >> 8, fp);
+        (void)fputc(value & 0xFF, fp);
+}
+
+static void
+_write32(FILE *fp, uint32_t value)
+{
+        _write16(fp, value >> 16);
+        _write16(fp, value & 0xFFFF);
+}
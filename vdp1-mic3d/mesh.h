@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef _MESH_H
+#define _MESH_H
+
+#include <stdint.h>
+
+/* Binary mesh, as generated by host/mesh-convert.
+ *
+ * All fields are big-endian. The file is a mesh_t header, followed by
+ * point_count points, face_count faces and face_count face normals. Every
+ * section is 4-byte aligned, so the file is used in place, straight out of
+ * the romdisk */
+
+#define MESH_SIGNATURE          "MESH"
+#define MESH_VERSION            3
+
+/* Largest coordinate, in 22.10 (2048 units). vdp1-mic3d sums its transform
+ * rows in 64 bits, so what bounds coordinates is the frustum test, which
+ * multiplies the bounding radius by the frustum edge lengths in 32 bits */
+#define MESH_COORD_MAX          (2048 << 10)
+
+/* Largest bounding radius, sqrt(3) * MESH_COORD_MAX rounded up. Leaves room
+ * for frustum edge lengths up to 591 (257 for the example's camera) */
+#define MESH_RADIUS_MAX         (3548 << 10)
+
+/* The face is drawn even when facing away from the camera */
+#define MESH_FACE_DOUBLE_SIDED  0x0001
+
+/* 22.10, already scaled */
+typedef struct {
+        int32_t x;
+        int32_t y;
+        int32_t z;
+} __attribute__ ((packed, aligned(4))) mesh_point_t;
+
+/* Triangles repeat their last point */
+typedef struct {
+        uint16_t p0;
+        uint16_t p1;
+        uint16_t p2;
+        uint16_t p3;
+        uint16_t flags;
+        uint16_t reserved;
+} __attribute__ ((packed, aligned(4))) mesh_face_t;
+
+/* Unit vector in 22.10, pointing out of the front of the face */
+typedef struct {
+        int16_t x;
+        int16_t y;
+        int16_t z;
+        int16_t reserved;
+} __attribute__ ((packed, aligned(4))) mesh_normal_t;
+
+typedef struct {
+        char signature[4];
+        uint16_t version;
+        uint16_t reserved;
+        uint16_t point_count;
+        uint16_t face_count;
+        /* Offsets from the start of the file */
+        uint32_t points_offset;
+        uint32_t faces_offset;
+        uint32_t normals_offset;
+        /* Bounding sphere about the origin, in 22.10 */
+        int32_t radius;
+} __attribute__ ((packed, aligned(4))) mesh_t;
+
+static inline const mesh_point_t *
+mesh_points_get(const mesh_t *mesh)
+{
+        return (const mesh_point_t *)((uintptr_t)mesh + mesh->points_offset);
+}
+
+static inline const mesh_face_t *
+mesh_faces_get(const mesh_t *mesh)
+{
+        return (const mesh_face_t *)((uintptr_t)mesh + mesh->faces_offset);
+}
+
+static inline const mesh_normal_t *
+mesh_normals_get(const mesh_t *mesh)
+{
+        return (const mesh_normal_t *)((uintptr_t)mesh + mesh->normals_offset);
+}
+
+#endif /* _MESH_H */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <yaul.h>
+
+#include "split_job.h"
+
+static void _slave_entry(void);
+
+/* Written by the master before notifying the slave */
+static volatile struct {
+        split_job_fn fn;
+        void *work;
+        uint32_t first;
+        uint32_t count;
+} _slave_job __section(".uncached");
+
+/* Only the master writes to the job count, and only the slave writes to the
+ * done count, so no lock is needed as long as both are kept uncached */
+static uint32_t _job_count = 0;
+static volatile uint32_t _slave_done_count __section(".uncached") = 0;
+
+void
+split_job_init(void)
+{
+        _job_count = 0;
+        _slave_done_count = 0;
+
+        cpu_dual_comm_mode_set(CPU_DUAL_ENTRY_ICI);
+        cpu_dual_slave_set(_slave_entry);
+}
+
+uint32_t
+split_job_run(split_job_fn fn, void *work, uint32_t count)
+{
+        const uint32_t master_count = (count + 1) / 2;
+
+        if (master_count == count) {
+                fn(work, 0, count);
+
+                return count;
+        }
+
+        _slave_job.fn = fn;
+        _slave_job.work = work;
+        _slave_job.first = master_count;
+        _slave_job.count = count - master_count;
+
+        _job_count++;
+
+        cpu_dual_slave_notify();
+
+        fn(work, 0, master_count);
+
+        while (_slave_done_count != _job_count) {
+        }
+
+        return master_count;
+}
+
+static void
+_slave_entry(void)
+{
+        /* Anything the job reads may have been written by the master since
+         * the last job */
+        cpu_cache_purge();
+
+        _slave_job.fn(_slave_job.work, _slave_job.first, _slave_job.count);
+
+        _slave_done_count++;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2006-2018
+ * See LICENSE for details.
+ *
+ * Mic
+ * Shazz
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef _SPLIT_JOB_H
+#define _SPLIT_JOB_H
+
+#include <stdint.h>
+
+/* Runs a job over a range of items on both CPUs. The master takes the lower
+ * half of the range and the slave the upper half. The job must only write to
+ * its own part of the output */
+typedef void (*split_job_fn)(void *work, uint32_t first, uint32_t count);
+
+void split_job_init(void);
+
+/* Returns once both halves are done, with the first item given to the slave
+ * (count if the slave wasn't used). The slave writes through to memory, but
+ * the master may still have stale copies of the slave's output in its cache;
+ * purge them with cache_area_purge() before reading them */
+uint32_t split_job_run(split_job_fn fn, void *work, uint32_t count);
+
+#endif /* _SPLIT_JOB_H */
@@ -9,35 +9,105 @@
 
 #include <yaul.h>
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "cache_area.h"
+#include "depth_sort.h"
+#include "dsp_transform.h"
+#include "mesh.h"
+#include "split_job.h"
+
 #define SCREEN_WIDTH    320
 #define SCREEN_HEIGHT   224
 
+/* Totals over all objects */
+#define POINT_COUNT_MAX 256
+#define FACE_COUNT_MAX  256
+
 #define ORDER_SYSTEM_CLIP_COORDS_INDEX  0
 #define ORDER_CLEAR_LOCAL_COORDS_INDEX  1
 #define ORDER_BUFFER_STARTING_INDEX     2
-#define ORDER_DRAW_END_INDEX            49
-#define ORDER_COUNT                     50
+#define ORDER_COUNT                     (ORDER_BUFFER_STARTING_INDEX + FACE_COUNT_MAX + 1)
 
 #define ELEMENT_COUNT(n) (sizeof((n)) / sizeof(*(n)))
 
 #define INT2FIX(a) (((int32_t)(a))<<10)
 #define FIX2INT(a) (((int32_t)(a))>>10)
 
+/* Rotation matrix elements carry 4 more fractional bits than _sintb, so that
+ * products of two table values are exact. A 22.10 coordinate times an 18.14
+ * element takes 32 bits past 128 units, so rows are summed in 64 bits */
+#define MATRIX_SHIFT 14
+
+/* The sum of 4 Z values (22.10) is scaled down to fit a 16-bit key */
+#define DEPTH_SORT_SHIFT 4
+
+#define SHADE_RAMP_COUNT 32
+
+/* Objects whose bounding sphere is entirely closer than this (in units) are
+ * rejected */
+#define FRUSTUM_NEAR     16
+
+/* Objects with fewer points aren't worth waking up the slave for */
+#define TRANSFORM_SPLIT_POINT_COUNT_MIN 16
+
+/* Set to 1 to rotate and translate on the SCU DSP, while the master projects
+ * (see shared/dsp_transform). The kernel is checked against the CPU transform
+ * with make -C ../shared/dsp_transform/host test, on a model of the DSP
+ * only, so the master/slave split stays the default */
+#define TRANSFORM_DSP   0
+
+/* The object is skipped entirely */
+#define OBJECT_FLAG_HIDDEN      0x01
+
 typedef struct {
         int32_t x;
         int32_t y;
         int32_t z;
 } __packed __aligned(4) point;
 
+/* 3x3 rotation (columns 0..2) in 18.14, and translation (column 3) in
+ * 22.10 */
+typedef struct {
+        int32_t m[3][4];
+} __aligned(4) matrix;
+
+typedef struct {
+        const char *filename;
+        uint8_t flags;
+        /* Integer units */
+        point position;
+        /* About X, then Y, then Z, in 256 steps per turn */
+        point rotation;
+
+        const mesh_t *mesh;
+        matrix matrix;
+        /* First point of the object in the screen space buffer */
+        uint32_t point_offset;
+        /* Direction towards the light, rotated into the object's space */
+        point light;
+} object;
+
+typedef struct {
+        object *objects;
+        uint32_t object_count;
+} scene;
+
+/* Work shared by both CPUs in _transform_project_job */
 typedef struct {
-        int32_t p0;
-        int32_t p1;
-        int32_t p2;
-        int32_t p3;
-} __packed quad;
+        const matrix *matrix;
+        const mesh_point_t *points;
+        uint32_t point_offset;
+} transform_job;
+
+/* A face that survived culling */
+typedef struct {
+        const mesh_face_t *face;
+        uint32_t point_offset;
+        color_rgb1555_t color;
+} visible_face;
 
 static uint8_t _sintb_buffer[] __aligned(4) = {
         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -191,159 +261,106 @@ static uint8_t _sintb_buffer[] __aligned(4) = {
 
 static int32_t *_sintb = (int32_t *)&_sintb_buffer[0];
 
-#define MODEL_POINT_COUNT       (ELEMENT_COUNT(_points_m) + ELEMENT_COUNT(_points_i) + ELEMENT_COUNT(_points_c))
-#define MODEL_FACE_COUNT        (ELEMENT_COUNT(_face_m) + ELEMENT_COUNT(_face_i) + ELEMENT_COUNT(_face_c))
-
-static point _points_m[28] = {
-        {-5, -3, -2},
-        {-3, -3, -2},
-        { 3, -3, -2},
-        { 5, -1, -2},
-        { 5,  3, -2},
-        { 3,  3, -2},
-        { 3, -1, -2},
-        { 1, -1, -2},
-        { 1,  3, -2},
-        {-1,  3, -2},
-        {-1, -1, -2},
-        {-3, -1, -2},
-        {-3,  3, -2},
-        {-5,  3, -2},
-        //
-        {-5, -3,  2},
-        {-3, -3,  2},
-        { 3, -3,  2},
-        { 5, -1,  2},
-        { 5,  3,  2},
-        { 3,  3,  2},
-        { 3, -1,  2},
-        { 1, -1,  2},
-        { 1,  3,  2},
-        {-1,  3,  2},
-        {-1, -1,  2},
-        {-3, -1,  2},
-        {-3,  3,  2},
-        {-5,  3,  2}
+extern uint8_t root_romdisk[];
+
+static object _objects[] = {
+        {
+                .filename = "/M.MSH",
+                .position = { -50, 0, 0 }
+        }, {
+                .filename = "/I.MSH",
+                .position = {   0, 0, 0 }
+        }, {
+                .filename = "/C.MSH",
+                .position = {  35, 0, 0 }
+        }
 };
 
-static point _points_i[10] = {
-        {-1, -3, -2},
-        { 1, -1, -2},
-        { 1,  3, -2},
-        {-1,  3, -2},
-        {-1, -1, -2},
-        //
-        {-1, -3,  2},
-        { 1, -1,  2},
-        { 1,  3,  2},
-        {-1,  3,  2},
-        {-1, -1,  2}
+static scene _scene = {
+        .objects = _objects,
+        .object_count = ELEMENT_COUNT(_objects)
 };
 
-static point _points_c[22] = {
-        {-3, -3, -2},
-        { 1, -3, -2},
-        { 3, -1, -2},
-        { 1, -1, -2},
-        {-1, -1, -2},
-        {-1,  1, -2},
-        { 3,  1, -2},
-        { 3,  3, -2},
-        {-1,  3, -2},
-        {-3,  3, -2},
-        {-3, -1, -2},
-        //
-        {-3, -3,  2},
-        { 1, -3,  2},
-        { 3, -1,  2},
-        { 1, -1,  2},
-        {-1, -1,  2},
-        {-1,  1,  2},
-        { 3,  1,  2},
-        { 3,  3,  2},
-        {-1,  3,  2},
-        {-3,  3,  2},
-        {-3, -1,  2}
-};
+/* View space points (22.10) of the object being transformed on the SCU DSP */
+static dsp_transform_point_t _view_points[POINT_COUNT_MAX];
 
-static quad _face_m[23] = {
-        { 0,  1, 12, 13},
-        { 1,  2,  6, 11},
-        { 6,  3,  4,  5},
-        {10,  7,  8,  9},
-        { 2,  3,  6,  6},
-        {14, 15, 26, 27},
-        {15, 16, 20, 25},
-        {20, 17, 18, 19},
-        {24, 21, 22, 23},
-        {16, 17, 20, 20},
-        { 0, 14, 16,  2},
-        {14,  0, 13, 27},
-        {13, 27, 26, 12},
-        {11, 25, 26, 12},
-        {25, 24, 10, 11},
-        {24, 10,  9, 23},
-        { 9, 23, 22,  8},
-        { 7, 21, 22,  8},
-        {21, 20,  6,  7},
-        {20,  6,  5, 19},
-        { 5, 19, 18,  4},
-        { 3, 17, 18,  4},
-        { 2, 16, 17,  3}
-};
+/* Screen space points of all objects, one slice per object */
+static struct {
+        int16_t x[POINT_COUNT_MAX];
+        int16_t y[POINT_COUNT_MAX];
+        int32_t z[POINT_COUNT_MAX];
+} __aligned(4) _screen_points;
 
-static quad _face_i[8] = {
-        { 0,  1,  4,  4},
-        { 1,  2,  3,  4},
-        { 0,  5,  6,  1},
-        { 1,  6,  7,  2},
-        { 3,  8,  7,  2},
-        { 5,  0,  3,  8},
-        { 5,  6,  9,  9},
-        { 6,  7,  8,  9}
-};
+static visible_face _visible_faces[FACE_COUNT_MAX];
+static uint32_t _visible_face_count;
 
-static quad _face_c[16] = {
-        { 0,  1,  3, 10},
-        { 1,  2,  3,  3},
-        {10,  4,  8,  9},
-        { 5,  6,  7,  8},
-        {11, 12, 14, 21},
-        {12, 13, 14, 14},
-        {21, 15, 19, 20},
-        {16, 17, 18, 19},
-        { 0, 11, 12,  1},
-        { 1, 12, 13,  2},
-        { 4, 15, 13,  2},
-        { 4, 15, 16,  5},
-        { 5, 16, 17,  6},
-        { 6, 17, 18,  7},
-        { 9, 20, 18,  7},
-        {11,  0,  9, 20}
+static depth_sort_entry_t _face_order[FACE_COUNT_MAX];
+static depth_sort_entry_t _face_order_scratch[FACE_COUNT_MAX];
+
+static point _camera;
+
+/* Side planes of the view frustum, through the eye and the screen edges. The
+ * lengths normalize their distances */
+static struct {
+        int32_t focal;
+        int32_t half_width;
+        int32_t half_height;
+        int32_t x_length;
+        int32_t y_length;
+} _frustum;
+
+/* Direction towards the light, which is above, left of and behind the
+ * camera. Unit vector in 22.10 */
+static const point _light = {
+        -418,
+        -418,
+        -836
 };
 
-static point _rotated_m[ELEMENT_COUNT(_points_m)];
-static point _projected_m[ELEMENT_COUNT(_points_m)];
+/* From faces turned away from the light to faces lit head on */
+static color_rgb1555_t _shade_ramp[SHADE_RAMP_COUNT];
 
-static point _rotated_i[ELEMENT_COUNT(_points_i)];
-static point _projected_i[ELEMENT_COUNT(_points_i)];
+/* Index of the command currently turned into a draw end */
+static uint32_t _cmdt_end_index = ORDER_BUFFER_STARTING_INDEX;
 
-static point _rotated_c[ELEMENT_COUNT(_points_c)];
-static point _projected_c[ELEMENT_COUNT(_points_c)];
+static smpc_peripheral_digital_t _digital;
 
-/* Allow max 64 faces to be sorted */
-static int32_t _avg_z[64];
+/* Toggled with A. Printing the stats every frame costs more than culling
+ * saves, so they're off by default */
+static bool _stats_overlay = false;
 
-static quad _faces[MODEL_FACE_COUNT];
-static point _all_points[MODEL_POINT_COUNT];
-static int32_t _face_order[MODEL_FACE_COUNT];
+/* Objects and faces dropped during the last frame */
+static uint32_t _rejected_object_count;
+static uint32_t _back_face_count;
+static uint32_t _off_screen_count;
 
-static point _camera;
+static void _vblank_out_handler(void *);
+
+static void _cmdts_init(vdp1_cmdt_list_t *);
+static void _cmdts_end_set(vdp1_cmdt_list_t *, uint32_t);
+
+static void _scene_load(scene *);
+static void _scene_process(scene *);
+static void _frustum_init(void);
+static bool _object_outside(const object *);
+static void _shade_ramp_init(void);
 
-static void _rotate(point *, point *, int32_t, int32_t);
-static void _transform(point *, point *, int32_t, int32_t, int32_t, int32_t);
-static void _project(point *, point *, int32_t);
-static void _sort_quads(quad *, point *, int32_t *, int32_t);
+static void _matrix_rotation_set(matrix *, int32_t, int32_t, int32_t);
+static void _matrix_translation_set(matrix *, int32_t, int32_t, int32_t);
+static void _light_set(object *);
+static inline int32_t _matrix_row_dot(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t);
+static void _transform_project(const matrix *, const mesh_point_t *, uint32_t, int32_t);
+static void _project(const dsp_transform_point_t *, uint32_t, uint32_t);
+static void _matrix_dsp_get(const matrix *, dsp_transform_matrix_t *);
+static uint32_t _transform_dsp_batch_count_get(uint32_t, uint32_t);
+static void _transform_project_dsp(const object *);
+static void _transform_project_split(const object *);
+static void _transform_project_job(void *, uint32_t, uint32_t);
+static void _cull_quads(const object *);
+static void _sort_quads(void);
+
+static inline bool _quad_back_facing(const int16_t *, const int16_t *, const mesh_face_t *);
+static inline bool _quad_off_screen(const int16_t *, const int16_t *, const mesh_face_t *);
 
 void
 main(void)
@@ -355,6 +372,10 @@ main(void)
         static const int16_vec2_t local_coord_center =
             INT16_VEC2_INITIALIZER(0, 0);
 
+        dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+        dbgio_dev_font_load();
+        dbgio_dev_font_load_wait();
+
         vdp1_cmdt_list_t *cmdt_list;
         cmdt_list = vdp1_cmdt_list_alloc(ORDER_COUNT);
 
@@ -371,246 +392,663 @@ main(void)
         vdp1_cmdt_param_vertex_set(&cmdts[ORDER_CLEAR_LOCAL_COORDS_INDEX],
             CMDT_VTX_LOCAL_COORD, &local_coord_center);
 
+        _cmdts_init(cmdt_list);
+
         uint32_t i;
         uint32_t j;
-        uint32_t k;
 
-        for (i = 0; i < ELEMENT_COUNT(_points_m); i++) {
-                _points_m[i].x = INT2FIX(_points_m[i].x * 6);
-                _points_m[i].y = INT2FIX(_points_m[i].y * 6);
-                _points_m[i].z = INT2FIX(_points_m[i].z * 6);
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_points_i); i++) {
-                _points_i[i].x = INT2FIX(_points_i[i].x * 6);
-                _points_i[i].y = INT2FIX(_points_i[i].y * 6);
-                _points_i[i].z = INT2FIX(_points_i[i].z * 6);
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_points_c); i++) {
-                _points_c[i].x = INT2FIX(_points_c[i].x * 6);
-                _points_c[i].y = INT2FIX(_points_c[i].y * 6);
-                _points_c[i].z = INT2FIX(_points_c[i].z * 6);
-        }
-
-        j = 0;
+        _scene_load(&_scene);
+        _shade_ramp_init();
 
-        for (i = 0; i < ELEMENT_COUNT(_face_m); i++, j++) {
-                _faces[j].p0 = _face_m[i].p0;
-                _faces[j].p1 = _face_m[i].p1;
-                _faces[j].p2 = _face_m[i].p2;
-                _faces[j].p3 = _face_m[i].p3;
-        }
+        split_job_init();
 
-        for (i = 0; i < ELEMENT_COUNT(_face_i); i++, j++) {
-                _faces[j].p0 = _face_i[i].p0 + 28;
-                _faces[j].p1 = _face_i[i].p1 + 28;
-                _faces[j].p2 = _face_i[i].p2 + 28;
-                _faces[j].p3 = _face_i[i].p3 + 28;
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_face_c); i++, j++) {
-                _faces[j].p0 = _face_c[i].p0 + 38;
-                _faces[j].p1 = _face_c[i].p1 + 38;
-                _faces[j].p2 = _face_c[i].p2 + 38;
-                _faces[j].p3 = _face_c[i].p3 + 38;
+        if (TRANSFORM_DSP) {
+                dsp_transform_init();
         }
 
         _camera.x = 160;
         _camera.y = 112;
         _camera.z = -200;
 
+        _frustum_init();
+
         int32_t theta = 0;
 
         while (true) {
-                vdp1_sync_cmdt_list_put(cmdt_list, 0, NULL, NULL);
+                smpc_peripheral_process();
+                smpc_peripheral_digital_port(1, &_digital);
+
+                if ((_digital.pressed.button.a) != 0) {
+                        _stats_overlay ^= true;
 
-                _rotate(_points_m, _rotated_m, theta, 28);
-                _rotate(_points_i, _rotated_i, theta, 10);
-                _rotate(_points_c, _rotated_c, theta, 22);
+                        dbgio_puts("[H[2J");
+                        dbgio_flush();
+                }
+
+                /* All objects spin about their own origin */
+                for (i = 0; i < _scene.object_count; i++) {
+                        _scene.objects[i].rotation.x = theta;
+                        _scene.objects[i].rotation.y = theta;
+                        _scene.objects[i].rotation.z = theta;
+                }
 
                 theta++;
 
-                _transform(_rotated_m, _rotated_m, -50, 0, 0, 28);
-                _transform(_rotated_c, _rotated_c, 35, 0, 0, 22);
+                _scene_process(&_scene);
 
-                _project(_rotated_m, _projected_m, 28);
-                _project(_rotated_i, _projected_i, 10);
-                _project(_rotated_c, _projected_c, 22);
+                _sort_quads();
 
-                j = 0;
+                const uint32_t face_count = _visible_face_count;
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_m); i++, j++) {
-                        _all_points[j] = _projected_m[i];
-                }
+                for (i = 0; i < face_count; i++) {
+                        j = DEPTH_SORT_ENTRY_INDEX(_face_order[i]);
+
+                        const mesh_face_t * const face = _visible_faces[j].face;
+
+                        const int16_t * const x = &_screen_points.x[_visible_faces[j].point_offset];
+                        const int16_t * const y = &_screen_points.y[_visible_faces[j].point_offset];
+
+                        /* Only the vertices and the color change from one
+                         * frame to the next */
+                        vdp1_cmdt_t *cmdt;
+                        cmdt = &cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + i];
+
+                        cmdt->cmd_xa = x[face->p0];
+                        cmdt->cmd_ya = y[face->p0];
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_i); i++, j++) {
-                        _all_points[j] = _projected_i[i];
+                        cmdt->cmd_xb = x[face->p3];
+                        cmdt->cmd_yb = y[face->p3];
+
+                        cmdt->cmd_xc = x[face->p2];
+                        cmdt->cmd_yc = y[face->p2];
+
+                        cmdt->cmd_xd = x[face->p1];
+                        cmdt->cmd_yd = y[face->p1];
+
+                        vdp1_cmdt_param_color_set(cmdt, _visible_faces[j].color);
                 }
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_c); i++, j++) {
-                        _all_points[j] = _projected_c[i];
+                _cmdts_end_set(cmdt_list, ORDER_BUFFER_STARTING_INDEX + face_count);
+
+                vdp1_sync_cmdt_list_put(cmdt_list, 0, NULL, NULL);
+
+                if (_stats_overlay) {
+                        dbgio_printf("[H[2Jrejected objects: %lu/%lu\nfaces: %lu/%lu\nback-facing: %lu\noff-screen: %lu\n",
+                            _rejected_object_count,
+                            _scene.object_count,
+                            face_count,
+                            face_count + _back_face_count + _off_screen_count,
+                            _back_face_count,
+                            _off_screen_count);
+
+                        dbgio_flush();
                 }
 
-                _sort_quads(_faces, _all_points, _face_order, MODEL_FACE_COUNT);
+                vdp_sync();
+        }
+}
 
-                for (i = 0; i < 47; i++) {
-                        j = _face_order[i];
+/* Every command past the coordinate commands is set up once as a polygon, so
+ * that a frame only has to write vertices and colors */
+static void
+_cmdts_init(vdp1_cmdt_list_t *cmdt_list)
+{
+        const vdp1_cmdt_draw_mode_t draw_mode = {
+                .raw = 0x0000
+        };
 
-                        /* Check which direction this quad is facing */
-                        k = ((-FIX2INT(_avg_z[i]) / 4) + 30);
+        uint32_t i;
 
-                        uint8_t r;
-                        r = 27 * k / 90 + 9;
+        for (i = ORDER_BUFFER_STARTING_INDEX; i < ORDER_COUNT; i++) {
+                vdp1_cmdt_t * const cmdt = &cmdt_list->cmdts[i];
 
-                        uint8_t g;
-                        g = 28 * k / 90 + 9;
+                vdp1_cmdt_polygon_set(cmdt);
+                vdp1_cmdt_param_draw_mode_set(cmdt, draw_mode);
+        }
 
-                        uint8_t b;
-                        b = 30 * k / 90 + 10;
+        _cmdts_end_set(cmdt_list, ORDER_BUFFER_STARTING_INDEX);
+}
 
-                        color_rgb1555_t color;
-                        color = COLOR_RGB1555(1, r, g, b);
+/* The previous draw end is turned back into a polygon, which is the only
+ * command that has to be set up again */
+static void
+_cmdts_end_set(vdp1_cmdt_list_t *cmdt_list, uint32_t end_index)
+{
+        vdp1_cmdt_polygon_set(&cmdt_list->cmdts[_cmdt_end_index]);
 
-                        vdp1_cmdt_draw_mode_t draw_mode = {
-                                .raw = 0x0000
-                        };
+        vdp1_cmdt_end_set(&cmdt_list->cmdts[end_index]);
 
-                        vdp1_cmdt_t *cmdt;
-                        cmdt = &cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + i];
+        _cmdt_end_index = end_index;
+
+        cmdt_list->count = end_index + 1;
+}
+
+/* Meshes are used in place, straight out of the romdisk */
+static void
+_scene_load(scene *s)
+{
+        romdisk_init();
+
+        void *romdisk;
+        romdisk = romdisk_mount("/", root_romdisk);
+        assert(romdisk != NULL);
+
+        uint32_t point_count;
+        point_count = 0;
+
+        uint32_t face_count;
+        face_count = 0;
+
+        uint32_t i;
+
+        for (i = 0; i < s->object_count; i++) {
+                object * const obj = &s->objects[i];
+
+                void *fh;
+                fh = romdisk_open(romdisk, obj->filename);
+                assert(fh != NULL);
+
+                const mesh_t * const mesh = romdisk_direct(fh);
+
+                assert((memcmp(mesh->signature, MESH_SIGNATURE, sizeof(mesh->signature))) == 0);
+                assert(mesh->version == MESH_VERSION);
+                assert(mesh->radius <= MESH_RADIUS_MAX);
+
+                obj->mesh = mesh;
+                obj->point_offset = point_count;
+
+                point_count += mesh->point_count;
+                face_count += mesh->face_count;
+        }
 
-                        /* Set the vertices directly as we have to cast from
-                         * int32_t to int16_t */
+        assert(point_count <= POINT_COUNT_MAX);
+        assert(face_count <= FACE_COUNT_MAX);
+}
 
-                        cmdt->cmd_xa = _all_points[_faces[j].p0].x;
-                        cmdt->cmd_ya = _all_points[_faces[j].p0].y;
+/* Objects outside of the view frustum are rejected before any of their points
+ * are transformed */
+static void
+_scene_process(scene *s)
+{
+        _visible_face_count = 0;
 
-                        cmdt->cmd_xb = _all_points[_faces[j].p3].x;
-                        cmdt->cmd_yb = _all_points[_faces[j].p3].y;
+        _rejected_object_count = 0;
+        _back_face_count = 0;
+        _off_screen_count = 0;
 
-                        cmdt->cmd_xc = _all_points[_faces[j].p2].x;
-                        cmdt->cmd_yc = _all_points[_faces[j].p2].y;
+        uint32_t i;
 
-                        cmdt->cmd_xd = _all_points[_faces[j].p1].x;
-                        cmdt->cmd_yd = _all_points[_faces[j].p1].y;
+        for (i = 0; i < s->object_count; i++) {
+                object * const obj = &s->objects[i];
 
-                        vdp1_cmdt_polygon_set(cmdt);
-                        vdp1_cmdt_param_draw_mode_set(cmdt, draw_mode);
-                        vdp1_cmdt_param_color_set(cmdt, color);
+                if ((obj->flags & OBJECT_FLAG_HIDDEN) != 0x00) {
+                        continue;
                 }
 
-                vdp1_cmdt_end_set(&cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + 47]);
+                _matrix_rotation_set(&obj->matrix,
+                    obj->rotation.x,
+                    obj->rotation.y,
+                    obj->rotation.z);
+                _matrix_translation_set(&obj->matrix,
+                    obj->position.x,
+                    obj->position.y,
+                    obj->position.z);
 
-                cmdt_list->count = ORDER_COUNT;
+                if (_object_outside(obj)) {
+                        _rejected_object_count++;
 
-                vdp1_sync_cmdt_list_put(cmdt_list, 0, NULL, NULL);
+                        continue;
+                }
 
-                vdp_sync();
+                _light_set(obj);
+
+                if (TRANSFORM_DSP) {
+                        _transform_project_dsp(obj);
+                } else {
+                        _transform_project_split(obj);
+                }
+
+                _cull_quads(obj);
         }
 }
 
 static void
-_rotate(point *in, point *out, int32_t angle, int32_t n)
+_frustum_init(void)
 {
-        int32_t i;
-        int32_t temp;
-        int32_t can, san;
+        _frustum.focal = -_camera.z;
+        _frustum.half_width = _camera.x;
+        _frustum.half_height = _camera.y;
 
-        san = _sintb[angle & 0xff];
-        can = _sintb[(angle + 0x40) & 0xff];
+        const uint32_t focal_squared = _frustum.focal * _frustum.focal;
 
-        for (i = 0; i < n; i++) {
-                /* About X */
-                out[i].y = ((in[i].y * can) - (in[i].z * san));
-                out[i].y = FIX2INT(out[i].y);
-                out[i].z = ((in[i].y * san) + (in[i].z * can));
-                out[i].z = FIX2INT(out[i].z);
-
-                /* About Y */
-                out[i].x = ((in[i].x * can) - (out[i].z * san));
-                out[i].x = FIX2INT(out[i].x);
-                out[i].z = ((in[i].x * san) + (out[i].z * can));
-                out[i].z = FIX2INT(out[i].z);
-
-                /* About Z */
-                temp = out[i].x;
-                out[i].x = ((out[i].x * can) - (out[i].y * san));
-                out[i].x = FIX2INT(out[i].x);
-                out[i].y = ((temp * san) + (out[i].y * can));
-                out[i].y = FIX2INT(out[i].y);
+        /* Integer square roots, only done once */
+        uint32_t x_length_squared;
+        x_length_squared = focal_squared + (_frustum.half_width * _frustum.half_width);
+
+        uint32_t y_length_squared;
+        y_length_squared = focal_squared + (_frustum.half_height * _frustum.half_height);
+
+        for (_frustum.x_length = 1;
+             (uint32_t)(_frustum.x_length * _frustum.x_length) < x_length_squared;
+             _frustum.x_length++) {
         }
 
+        for (_frustum.y_length = 1;
+             (uint32_t)(_frustum.y_length * _frustum.y_length) < y_length_squared;
+             _frustum.y_length++) {
+        }
+
+        /* _object_outside() multiplies bounding radii by these in 32 bits */
+        assert(_frustum.x_length <= (INT32_MAX / MESH_RADIUS_MAX));
+        assert(_frustum.y_length <= (INT32_MAX / MESH_RADIUS_MAX));
+}
+
+/* Tests the bounding sphere of the object, centered on its origin, against the
+ * near plane and the four side planes of the view frustum */
+static bool
+_object_outside(const object *obj)
+{
+        const matrix * const m = &obj->matrix;
+
+        const int32_t x = m->m[0][3];
+        const int32_t y = m->m[1][3];
+        const int32_t radius = obj->mesh->radius;
+
+        /* Distance from the eye, along the view axis */
+        const int32_t depth = m->m[2][3] - INT2FIX(_camera.z);
+
+        if ((depth + radius) < INT2FIX(FRUSTUM_NEAR)) {
+                return true;
+        }
+
+        const int32_t x_distance = radius * _frustum.x_length;
+        const int32_t y_distance = radius * _frustum.y_length;
+
+        const int32_t x_focal = x * _frustum.focal;
+        const int32_t y_focal = y * _frustum.focal;
+
+        const int32_t x_depth = depth * _frustum.half_width;
+        const int32_t y_depth = depth * _frustum.half_height;
+
+        return (((x_focal - x_depth) > x_distance) ||
+                ((-x_focal - x_depth) > x_distance) ||
+                ((y_focal - y_depth) > y_distance) ||
+                ((-y_focal - y_depth) > y_distance));
 }
 
+/* Same range of colors the faces used to be shaded with by depth. The
+ * divisions are only done here, once */
 static void
-_transform(point *in, point *out, int32_t xt, int32_t yt, int32_t zt, int32_t n)
+_shade_ramp_init(void)
 {
-        int32_t i;
+        uint32_t i;
 
-        xt = INT2FIX(xt);
-        yt = INT2FIX(yt);
-        zt = INT2FIX(zt);
+        for (i = 0; i < SHADE_RAMP_COUNT; i++) {
+                const uint8_t r = 9 + ((18 * i) / (SHADE_RAMP_COUNT - 1));
+                const uint8_t g = 9 + ((19 * i) / (SHADE_RAMP_COUNT - 1));
+                const uint8_t b = 10 + ((20 * i) / (SHADE_RAMP_COUNT - 1));
 
-        for (i = 0; i < n; i++) {
-                out[i].x = in[i].x + xt;
-                out[i].y = in[i].y + yt;
-                out[i].z = in[i].z + zt;
+                _shade_ramp[i] = COLOR_RGB1555(1, r, g, b);
         }
 }
 
+/* Same rotation as rotating about X, then Y, then Z. Each element is rounded
+ * once, instead of once per axis for every vertex */
+static void
+_matrix_rotation_set(matrix *m, int32_t ax, int32_t ay, int32_t az)
+{
+        const int32_t sx = _sintb[ax & 0xff];
+        const int32_t cx = _sintb[(ax + 0x40) & 0xff];
+        const int32_t sy = _sintb[ay & 0xff];
+        const int32_t cy = _sintb[(ay + 0x40) & 0xff];
+        const int32_t sz = _sintb[az & 0xff];
+        const int32_t cz = _sintb[(az + 0x40) & 0xff];
+
+        /* Products of two and three 22.10 values are in 12.20 and 2.30 */
+        m->m[0][0] = (cz * cy) >> (20 - MATRIX_SHIFT);
+        m->m[0][1] = ((-cz * sy * sx) - (INT2FIX(sz) * cx)) >> (30 - MATRIX_SHIFT);
+        m->m[0][2] = ((-cz * sy * cx) + (INT2FIX(sz) * sx)) >> (30 - MATRIX_SHIFT);
+
+        m->m[1][0] = (sz * cy) >> (20 - MATRIX_SHIFT);
+        m->m[1][1] = ((-sz * sy * sx) + (INT2FIX(cz) * cx)) >> (30 - MATRIX_SHIFT);
+        m->m[1][2] = ((-sz * sy * cx) - (INT2FIX(cz) * sx)) >> (30 - MATRIX_SHIFT);
+
+        m->m[2][0] = sy << (MATRIX_SHIFT - 10);
+        m->m[2][1] = (cy * sx) >> (20 - MATRIX_SHIFT);
+        m->m[2][2] = (cy * cx) >> (20 - MATRIX_SHIFT);
+}
+
 static void
-_project(point *in, point *out, int32_t n)
+_matrix_translation_set(matrix *m, int32_t xt, int32_t yt, int32_t zt)
 {
+        m->m[0][3] = INT2FIX(xt);
+        m->m[1][3] = INT2FIX(yt);
+        m->m[2][3] = INT2FIX(zt);
+}
+
+/* The rotation is orthonormal, so its transpose takes the light into the
+ * object's space. Face normals are then used as they are in the mesh */
+static void
+_light_set(object *obj)
+{
+        const matrix * const m = &obj->matrix;
+
+        obj->light.x = ((m->m[0][0] * _light.x) + (m->m[1][0] * _light.y) + (m->m[2][0] * _light.z)) >> MATRIX_SHIFT;
+        obj->light.y = ((m->m[0][1] * _light.x) + (m->m[1][1] * _light.y) + (m->m[2][1] * _light.z)) >> MATRIX_SHIFT;
+        obj->light.z = ((m->m[0][2] * _light.x) + (m->m[1][2] * _light.y) + (m->m[2][2] * _light.z)) >> MATRIX_SHIFT;
+}
+
+/* One row of the rotation. Each product is a single dmuls.l */
+static inline int32_t __always_inline
+_matrix_row_dot(int32_t x, int32_t y, int32_t z, int32_t m0, int32_t m1,
+    int32_t m2)
+{
+        const int64_t sum = ((int64_t)x * m0) + ((int64_t)y * m1) +
+            ((int64_t)z * m2);
+
+        return (int32_t)(sum >> MATRIX_SHIFT);
+}
+
+/* Rotate, translate and project in one pass, writing straight into the
+ * object's slice of the screen space buffer */
+static void
+_transform_project(const matrix *m, const mesh_point_t *in, uint32_t offset, int32_t n)
+{
+        const int32_t m00 = m->m[0][0];
+        const int32_t m01 = m->m[0][1];
+        const int32_t m02 = m->m[0][2];
+        const int32_t m10 = m->m[1][0];
+        const int32_t m11 = m->m[1][1];
+        const int32_t m12 = m->m[1][2];
+        const int32_t m20 = m->m[2][0];
+        const int32_t m21 = m->m[2][1];
+        const int32_t m22 = m->m[2][2];
+
+        int16_t * const out_x = &_screen_points.x[offset];
+        int16_t * const out_y = &_screen_points.y[offset];
+        int32_t * const out_z = &_screen_points.z[offset];
+
         int32_t i;
 
         for (i = 0; i < n; i++) {
-                const int32_t inx = in[i].x; 
+                const int32_t inx = in[i].x;
                 const int32_t iny = in[i].y;
                 const int32_t inz = in[i].z;
 
-                const int32_t divisor = (_camera.z - FIX2INT(inz));
+                const int32_t z = _matrix_row_dot(inx, iny, inz, m20, m21, m22) + m->m[2][3];
 
-                const int32_t scaled_x = inx * _camera.z;
-                const int32_t scaled_y = iny * _camera.z;
+                /* Start the divider on the perspective scale (16.16) as soon
+                 * as Z is known, and compute X and Y while it runs */
+                cpu_divu_fix16_set(_camera.z, _camera.z - FIX2INT(z));
 
-                out[i].x = _camera.x + FIX2INT((scaled_x / divisor));
-                out[i].y = _camera.y + FIX2INT((scaled_y / divisor));
-                out[i].z = inz;
+                const int32_t x = _matrix_row_dot(inx, iny, inz, m00, m01, m02) + m->m[0][3];
+                const int32_t y = _matrix_row_dot(inx, iny, inz, m10, m11, m12) + m->m[1][3];
+
+                const fix16_t scale = cpu_divu_quotient_get();
+
+                out_x[i] = _camera.x + FIX2INT(fix16_mul(x, scale));
+                out_y[i] = _camera.y + FIX2INT(fix16_mul(y, scale));
+                out_z[i] = z;
         }
 }
 
+/* The points of large objects are split between the master and the slave */
 static void
-_sort_quads(quad *f, point *p, int32_t *order, int32_t n)
+_transform_project_split(const object *obj)
 {
-        int32_t i;
-        int32_t j;
-        int32_t tmp;
+        const uint32_t point_count = obj->mesh->point_count;
+
+        if (point_count < TRANSFORM_SPLIT_POINT_COUNT_MIN) {
+                _transform_project(&obj->matrix, mesh_points_get(obj->mesh),
+                    obj->point_offset, point_count);
+
+                return;
+        }
+
+        transform_job job = {
+                .matrix = &obj->matrix,
+                .points = mesh_points_get(obj->mesh),
+                .point_offset = obj->point_offset
+        };
+
+        const uint32_t slave_first = split_job_run(_transform_project_job, &job,
+            point_count);
+
+        /* The slave's points are read back during culling */
+        const uint32_t slave_offset = obj->point_offset + slave_first;
+        const uint32_t slave_count = point_count - slave_first;
+
+        cache_area_purge(&_screen_points.x[slave_offset], slave_count * sizeof(int16_t));
+        cache_area_purge(&_screen_points.y[slave_offset], slave_count * sizeof(int16_t));
+        cache_area_purge(&_screen_points.z[slave_offset], slave_count * sizeof(int32_t));
+}
+
+static void
+_transform_project_job(void *work, uint32_t first, uint32_t count)
+{
+        const transform_job * const job = work;
+
+        _transform_project(job->matrix, &job->points[first],
+            job->point_offset + first, count);
+}
+
+/* Same projection as _transform_project(), from points already in view
+ * space. The divider works on the next point's scale while the current point
+ * is scaled */
+static void
+_project(const dsp_transform_point_t *in, uint32_t offset, uint32_t n)
+{
+        int16_t * const out_x = &_screen_points.x[offset];
+        int16_t * const out_y = &_screen_points.y[offset];
+        int32_t * const out_z = &_screen_points.z[offset];
+
+        cpu_divu_fix16_set(_camera.z, _camera.z - FIX2INT(in[0].z));
+
+        uint32_t i;
 
-        /* Initialize arrays */
         for (i = 0; i < n; i++) {
-                _avg_z[i] = p[f[i].p0].z +
-                            p[f[i].p1].z +
-                            p[f[i].p2].z +
-                            p[f[i].p3].z;
-                order[i] = i;
+                const fix16_t scale = cpu_divu_quotient_get();
+
+                if ((i + 1) < n) {
+                        cpu_divu_fix16_set(_camera.z, _camera.z - FIX2INT(in[i + 1].z));
+                }
+
+                out_x[i] = _camera.x + FIX2INT(fix16_mul(in[i].x, scale));
+                out_y[i] = _camera.y + FIX2INT(fix16_mul(in[i].y, scale));
+                out_z[i] = in[i].z;
+        }
+}
+
+/* The DSP takes its rotation in 16.16. Shifting the 18.14 elements up keeps
+ * every bit, so the DSP's 48-bit sums drop exactly the bits
+ * _matrix_row_dot() drops. The translation is in 22.10, like the points */
+static void
+_matrix_dsp_get(const matrix *m, dsp_transform_matrix_t *dsp_m)
+{
+        uint32_t row;
+
+        for (row = 0; row < 3; row++) {
+                dsp_m->m[row][0] = m->m[row][0] << (16 - MATRIX_SHIFT);
+                dsp_m->m[row][1] = m->m[row][1] << (16 - MATRIX_SHIFT);
+                dsp_m->m[row][2] = m->m[row][2] << (16 - MATRIX_SHIFT);
+                dsp_m->m[row][3] = m->m[row][3];
+        }
+}
+
+static uint32_t
+_transform_dsp_batch_count_get(uint32_t point_count, uint32_t first)
+{
+        const uint32_t count = point_count - first;
+
+        if (count > DSP_TRANSFORM_BATCH_COUNT) {
+                return DSP_TRANSFORM_BATCH_COUNT;
+        }
+
+        return count;
+}
+
+/* The DSP rotates and translates a batch of points while the master projects
+ * the previous one. The slave is left alone */
+static void
+_transform_project_dsp(const object *obj)
+{
+        dsp_transform_matrix_t dsp_m;
+        _matrix_dsp_get(&obj->matrix, &dsp_m);
+
+        dsp_transform_matrix_set(&dsp_m);
+
+        /* Points are DMA'd straight out of the mesh */
+        _Static_assert(sizeof(mesh_point_t) == sizeof(dsp_transform_point_t),
+            "mesh_point_t and dsp_transform_point_t differ");
+        _Static_assert(offsetof(mesh_point_t, x) == offsetof(dsp_transform_point_t, x),
+            "mesh_point_t and dsp_transform_point_t differ");
+        _Static_assert(offsetof(mesh_point_t, y) == offsetof(dsp_transform_point_t, y),
+            "mesh_point_t and dsp_transform_point_t differ");
+        _Static_assert(offsetof(mesh_point_t, z) == offsetof(dsp_transform_point_t, z),
+            "mesh_point_t and dsp_transform_point_t differ");
+
+        const dsp_transform_point_t * const points =
+            (const dsp_transform_point_t *)mesh_points_get(obj->mesh);
+        const uint32_t point_count = obj->mesh->point_count;
+
+        uint32_t first;
+        first = 0;
+
+        uint32_t count;
+        count = _transform_dsp_batch_count_get(point_count, 0);
+
+        if (count == 0) {
+                return;
         }
 
+        dsp_transform_batch_start(&points[0], &_view_points[0], count);
+
+        while (count > 0) {
+                dsp_transform_batch_wait();
+
+                const uint32_t next = first + count;
+                const uint32_t next_count =
+                    _transform_dsp_batch_count_get(point_count, next);
+
+                if (next_count > 0) {
+                        dsp_transform_batch_start(&points[next],
+                            &_view_points[next], next_count);
+                }
+
+                _project(&_view_points[first], obj->point_offset + first, count);
+
+                first = next;
+                count = next_count;
+        }
+}
+
+/* Appends the faces of the object that are facing the camera and on screen
+ * to the faces to sort */
+static void
+_cull_quads(const object *obj)
+{
+        const int16_t * const x = &_screen_points.x[obj->point_offset];
+        const int16_t * const y = &_screen_points.y[obj->point_offset];
+        const int32_t * const z = &_screen_points.z[obj->point_offset];
+
+        const mesh_face_t * const faces = mesh_faces_get(obj->mesh);
+        const mesh_normal_t * const normals = mesh_normals_get(obj->mesh);
+
+        const int32_t lx = obj->light.x;
+        const int32_t ly = obj->light.y;
+        const int32_t lz = obj->light.z;
+
+        uint32_t i;
+
+        for (i = 0; i < obj->mesh->face_count; i++) {
+                const mesh_face_t * const f = &faces[i];
+
+                if (((f->flags & MESH_FACE_DOUBLE_SIDED) == 0x0000) &&
+                    _quad_back_facing(x, y, f)) {
+                        _back_face_count++;
+
+                        continue;
+                }
+
+                if (_quad_off_screen(x, y, f)) {
+                        _off_screen_count++;
 
-        /* Bubble-sort the whole lot... yeehaw! */
-        for (i = 0; i < (n - 1); i++) {
-                for (j = i + 1; j < n; j++) {
-                        if (_avg_z[j] > _avg_z[i]) {
-                                tmp = _avg_z[i];
-                                _avg_z[i] = _avg_z[j];
-                                _avg_z[j] = tmp;
-                                tmp = order[i];
-                                order[i] = order[j];
-                                order[j] = tmp;
-                        }
+                        continue;
                 }
+
+                const uint32_t index = _visible_face_count;
+
+                _visible_faces[index].face = f;
+                _visible_faces[index].point_offset = obj->point_offset;
+
+                const int32_t avg_z = z[f->p0] +
+                                      z[f->p1] +
+                                      z[f->p2] +
+                                      z[f->p3];
+
+                _face_order[index] = DEPTH_SORT_ENTRY(
+                        depth_sort_key(avg_z, DEPTH_SORT_SHIFT), index);
+
+                const mesh_normal_t * const n = &normals[i];
+
+                /* Lambert term in 22.10, clamped to [0, 1] */
+                int32_t intensity;
+                intensity = FIX2INT((n->x * lx) + (n->y * ly) + (n->z * lz));
+                intensity = (intensity < 0) ? 0 : intensity;
+                intensity = (intensity > INT2FIX(1)) ? INT2FIX(1) : intensity;
+
+                _visible_faces[index].color =
+                    _shade_ramp[(intensity * (SHADE_RAMP_COUNT - 1)) >> 10];
+
+                _visible_face_count++;
         }
 }
 
+/* Sorts the visible faces far to near */
+static void
+_sort_quads(void)
+{
+        depth_sort(_face_order, _face_order_scratch, _visible_face_count);
+}
+
+/* Faces are wound so that, once projected, the cross product of their
+ * diagonals is negative when facing the camera. Edge-on faces are dropped
+ * too */
+static inline bool
+_quad_back_facing(const int16_t *x, const int16_t *y, const mesh_face_t *f)
+{
+        const int32_t x0 = x[f->p0];
+        const int32_t y0 = y[f->p0];
+        const int32_t x1 = x[f->p1];
+        const int32_t y1 = y[f->p1];
+        const int32_t x2 = x[f->p2];
+        const int32_t y2 = y[f->p2];
+        const int32_t x3 = x[f->p3];
+        const int32_t y3 = y[f->p3];
+
+        return ((((x2 - x0) * (y3 - y1)) - ((y2 - y0) * (x3 - x1))) >= 0);
+}
+
+static inline bool
+_quad_off_screen(const int16_t *x, const int16_t *y, const mesh_face_t *f)
+{
+        if ((x[f->p0] < 0) && (x[f->p1] < 0) && (x[f->p2] < 0) && (x[f->p3] < 0)) {
+                return true;
+        }
+
+        if ((x[f->p0] >= SCREEN_WIDTH) && (x[f->p1] >= SCREEN_WIDTH) &&
+            (x[f->p2] >= SCREEN_WIDTH) && (x[f->p3] >= SCREEN_WIDTH)) {
+                return true;
+        }
+
+        if ((y[f->p0] < 0) && (y[f->p1] < 0) && (y[f->p2] < 0) && (y[f->p3] < 0)) {
+                return true;
+        }
+
+        return ((y[f->p0] >= SCREEN_HEIGHT) && (y[f->p1] >= SCREEN_HEIGHT) &&
+                (y[f->p2] >= SCREEN_HEIGHT) && (y[f->p3] >= SCREEN_HEIGHT));
+}
+
 void
 user_init(void)
 {
@@ -632,4 +1070,12 @@ user_init(void)
         cpu_intc_mask_set(0);
 
         vdp2_tvmd_display_set();
+
+        vdp_sync_vblank_out_set(_vblank_out_handler);
+}
+
+static void
+_vblank_out_handler(void *work __unused)
+{
+        smpc_peripheral_intback_issue();
 }
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <yaul.h>
+
+#include "cd_stream.h"
+#include "scene.h"
+
+using scene::decoder::chunk_size;
+
+static constexpr uint32_t _sector_size = 2048;
+static constexpr uint32_t _chunk_sector_count = chunk_size / _sector_size;
+
+// 4 * 64 KiB out of the 1 MiB of LWRAM
+static constexpr uint32_t _ring_count = 4;
+
+// Sectors read per call to refill(). cd_block_sector_read() blocks, so this
+// bounds the time spent per call. The scene needs about 11 sectors/s
+static constexpr uint32_t _refill_sector_count = 2;
+
+static iso9660_filelist_t _filelist;
+static iso9660_filelist_entry_t _filelist_entries[ISO9660_FILELIST_ENTRIES_COUNT];
+
+static uint32_t _starting_fad;
+static uint32_t _sector_count;
+static uint32_t _chunk_count;
+static bool _refill_on_wait;
+
+/* Chunks are counted in the order they're played (the sequence), so that
+ * looping back to chunk 0 keeps the ring filled ahead. Only refill() writes
+ * _loaded_count and only chunk_get() writes _played_count, so both just need
+ * to be kept uncached */
+static volatile uint32_t _loaded_count __section(".uncached") = 0;
+static volatile uint32_t _played_count __section(".uncached") = 0;
+
+/* Next sector to read within the chunk being loaded */
+static uint32_t _load_sector = 0;
+
+static const iso9660_filelist_entry_t* _filelist_entry_find(const char *);
+
+static uint8_t* _chunk_buffer_get(uint32_t);
+static uint32_t _chunk_sector_count_get(uint32_t);
+
+bool cd_stream::init(const char* filename, bool refill_on_wait) {
+    _filelist.entries = _filelist_entries;
+    _filelist.entries_count = 0;
+    _filelist.entries_pooled_count = 0;
+
+    iso9660_filelist_read(&_filelist, -1);
+
+    const iso9660_filelist_entry_t* const file_entry =
+        _filelist_entry_find(filename);
+
+    if ((file_entry == NULL) || (file_entry->sector_count == 0)) {
+        return false;
+    }
+
+    _starting_fad = file_entry->starting_fad;
+    _sector_count = file_entry->sector_count;
+    _chunk_count = (_sector_count + _chunk_sector_count - 1) / _chunk_sector_count;
+    _refill_on_wait = refill_on_wait;
+
+    /* Fill the ring up front, so that playback doesn't start out waiting */
+    while (_loaded_count < (_ring_count - 1)) {
+        refill();
+    }
+
+    return true;
+}
+
+void cd_stream::refill(void) {
+    for (uint32_t i = 0; i < _refill_sector_count; i++) {
+        const uint32_t sequence = _loaded_count;
+
+        /* Don't overwrite the chunk being decoded */
+        if (sequence >= (_played_count + _ring_count - 1)) {
+            return;
+        }
+
+        const uint32_t chunk_index = sequence % _chunk_count;
+
+        uint8_t* const buffer = _chunk_buffer_get(sequence);
+
+        const uint32_t fad = _starting_fad +
+            (chunk_index * _chunk_sector_count) + _load_sector;
+
+        int ret __unused;
+        ret = cd_block_sector_read(fad, &buffer[_load_sector * _sector_size]);
+        assert(ret == 0);
+
+        _load_sector++;
+
+        if (_load_sector == _chunk_sector_count_get(chunk_index)) {
+            _load_sector = 0;
+
+            /* Publish the chunk only once it's completely read */
+            _loaded_count = sequence + 1;
+        }
+    }
+}
+
+const uint8_t* cd_stream::chunk_get(uint32_t chunk_index) {
+    const uint32_t sequence = _played_count;
+
+    assert(chunk_index == (sequence % _chunk_count));
+
+    /* Release the previous chunk's buffer */
+    _played_count = sequence + 1;
+
+    while (_loaded_count <= sequence) {
+        if (_refill_on_wait) {
+            refill();
+        }
+    }
+
+    /* The slot was last read as an earlier chunk, possibly through this
+     * CPU's cache. The cache is much smaller than a chunk, so purging all of
+     * it is cheaper than going line by line */
+    cpu_cache_purge();
+
+    return _chunk_buffer_get(sequence);
+}
+
+static const iso9660_filelist_entry_t* _filelist_entry_find(const char *filename) {
+    const size_t length = strlen(filename);
+
+    for (uint32_t i = 0; i < _filelist.entries_count; i++) {
+        const iso9660_filelist_entry_t* const file_entry = &_filelist.entries[i];
+
+        if (strncmp(file_entry->name, filename, length) != 0) {
+            continue;
+        }
+
+        /* Ignore the version suffix, if any */
+        if ((file_entry->name[length] == '\0') || (file_entry->name[length] == ';')) {
+            return file_entry;
+        }
+    }
+
+    return NULL;
+}
+
+static uint8_t* _chunk_buffer_get(uint32_t sequence) {
+    return reinterpret_cast<uint8_t*>(LWRAM(chunk_size * (sequence % _ring_count)));
+}
+
+static uint32_t _chunk_sector_count_get(uint32_t chunk_index) {
+    const uint32_t first_sector = chunk_index * _chunk_sector_count;
+    const uint32_t remaining_sector_count = _sector_count - first_sector;
+
+    return ((remaining_sector_count < _chunk_sector_count)
+            ? remaining_sector_count
+            : _chunk_sector_count);
+}
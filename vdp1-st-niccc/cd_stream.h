@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef CD_STREAM_H_
+#define CD_STREAM_H_
+
+#include <stdint.h>
+
+/* Streams a file from CD into a ring of scene::decoder::chunk_size buffers
+ * in LWRAM, to be handed to scene::init() as the chunk handler. Chunks have
+ * to be requested in playback order (seeking isn't supported).
+ *
+ * The CD block is only accessed from refill(), which reads a few sectors
+ * ahead of the decoder each time it's called. If refill_on_wait is set,
+ * chunk_get() calls refill() itself while waiting on a chunk, which is needed
+ * when decoding on the same CPU that refills */
+namespace cd_stream {
+    bool init(const char* filename, bool refill_on_wait);
+
+    void refill(void);
+
+    const uint8_t* chunk_get(uint32_t chunk_index);
+};
+
+#endif // CD_STREAM_H_
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef CMD_STREAM_H_
+#define CMD_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Precompiled ST-NICCC command stream, as generated by host/scene-convert.
+//
+// All fields are big-endian. The file starts with a header, followed by
+// frame_count frame records. Each frame record is:
+//
+//   frame_header
+//   color_rgb1555_t palette[palette_count]  // CRAM 0x10 + palette_first
+//   (padding up to a 32-byte boundary)
+//   vdp1_cmdt cmdts[cmdt_count]             // Last command is a draw end
+//
+// Every record starts on a 32-byte boundary, so the command tables can be
+// transferred to VDP1 VRAM as-is
+namespace cmd_stream {
+    constexpr char signature[4] = { 'N', 'C', 'M', 'D' };
+    constexpr uint16_t version = 1;
+    constexpr size_t alignment = 32;
+    constexpr size_t cmdt_size = 32;
+
+    enum frame_flags : uint16_t {
+        FRAME_CLEAR_SCREEN = 1 << 0,
+        FRAME_LAST         = 1 << 1
+    };
+
+    struct header {
+        char signature[4];
+        uint16_t version;
+        uint16_t frame_count;
+        uint32_t size;
+        uint8_t reserved[20];
+    } __attribute__ ((packed));
+
+    struct frame_header {
+        uint16_t flags;
+        uint16_t cmdt_count;
+        uint8_t palette_first;
+        uint8_t palette_count;
+        uint16_t reserved;
+        // Size in bytes of the whole record, including the header
+        uint32_t size;
+        uint32_t reserved2;
+    } __attribute__ ((packed));
+
+    static_assert(sizeof(header) == alignment);
+    static_assert(sizeof(frame_header) == 16);
+
+    constexpr inline size_t align(size_t size) {
+        return (size + (alignment - 1)) & ~(alignment - 1);
+    }
+
+    // Offset of the command tables from the start of the frame record
+    constexpr inline size_t cmdts_offset(uint8_t palette_count) {
+        return align(sizeof(frame_header) + (palette_count * sizeof(uint16_t)));
+    }
+};
+
+#endif // CMD_STREAM_H_
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scene.h"
+
+static constexpr uint32_t _replay_count_default = 100;
+
+static const char* _scene_file_path = "../romdisk/SCENE.BIN";
+
+struct bench_stats {
+    uint32_t frame_count;
+    uint32_t polygon_count;
+    uint32_t vertex_count;
+    uint32_t transform_count;
+    uint32_t cmdt_count;
+    uint32_t palette_count;
+    uint32_t max_polygon_count;
+    uint32_t frame_polygon_count;
+    uint64_t byte_count;
+    bool last_frame;
+};
+
+// Same bookkeeping as the callbacks, but resolved at compile time
+struct bench_emitter {
+    inline void on_start(uint32_t, bool);
+    inline void on_end(uint32_t, bool last_frame);
+    inline void on_update_palette(uint8_t, const scene::rgb444);
+    inline void on_palette_changed(uint16_t) { }
+    inline void on_clear_screen(bool) { }
+    inline void on_transform(int16_vec2_t*, const size_t count);
+    inline void on_draw(int16_vec2_t const *, const size_t count, const uint8_t);
+};
+
+static bench_stats _stats;
+
+static bench_emitter _emitter;
+
+static uint32_t _start_frame = 0;
+
+static uint8_t* _file_read(const char* path, size_t& size);
+static double _time_get(void);
+
+static void _replay_callbacks(uint32_t replay_count);
+static void _replay_emitter(uint32_t replay_count);
+static void _report(const char* mode, void (*replay)(uint32_t),
+                    uint32_t replay_count);
+
+static void _on_start(uint32_t, bool);
+static void _on_end(uint32_t, bool);
+static void _on_update_palette(uint8_t, const scene::rgb444);
+static void _on_transform(int16_vec2_t*, const size_t);
+static void _on_draw(int16_vec2_t const *, const size_t, const uint8_t);
+
+int main(int argc, char* argv[]) {
+    const char* const path = (argc > 1) ? argv[1] : _scene_file_path;
+    const uint32_t replay_count =
+        (argc > 2) ? strtoul(argv[2], nullptr, 0) : _replay_count_default;
+    _start_frame = (argc > 3) ? strtoul(argv[3], nullptr, 0) : 0;
+
+    size_t size;
+    uint8_t* const buffer = _file_read(path, size);
+
+    if (buffer == nullptr) {
+        fprintf(stderr, "Unable to read %s\n", path);
+
+        return 1;
+    }
+
+    const uint8_t* scene_buffer = buffer;
+
+    scene::callbacks callbacks;
+    callbacks.on_start = _on_start;
+    callbacks.on_end = _on_end;
+    callbacks.on_clear_screen = nullptr;
+    callbacks.on_update_palette = _on_update_palette;
+    callbacks.on_palette_changed = nullptr;
+    callbacks.on_transform = _on_transform;
+    callbacks.on_draw = _on_draw;
+
+    scene::init(scene_buffer, size, callbacks);
+
+    scene::validation validation;
+
+    scene::validate(validation);
+
+    if (!validation.valid) {
+        fprintf(stderr, "%s: %s (frame %u, offset 0x%08X)\n", path,
+                validation.error, validation.frame_index, validation.offset);
+
+        free(buffer);
+
+        return 1;
+    }
+
+    const double index_start_time = _time_get();
+
+    scene::index_build();
+
+    const double index_time = _time_get() - index_start_time;
+
+    if (_start_frame >= scene::frame_count()) {
+        fprintf(stderr, "Start frame %u is out of range (%u frames)\n",
+                _start_frame, scene::frame_count());
+
+        free(buffer);
+
+        return 1;
+    }
+
+    printf("file:              %s (%zu bytes)\n", path, size);
+    printf("replays:           %u\n", replay_count);
+    printf("frames:            %u (indexed in %.3f ms)\n",
+           scene::frame_count(), index_time * 1000.0);
+    printf("start frame:       %u\n", _start_frame);
+    printf("peak frame:        %u polygons, %u quads\n",
+           validation.max_polygon_count, validation.max_quad_count);
+
+    _report("callbacks", _replay_callbacks, replay_count);
+    _report("emitter", _replay_emitter, replay_count);
+
+    free(buffer);
+
+    return 0;
+}
+
+static void _replay_callbacks(uint32_t replay_count) {
+    for (uint32_t replay = 0; replay < replay_count; replay++) {
+        scene::seek(_start_frame);
+
+        _stats.last_frame = false;
+
+        const uint32_t start_offset = scene::decoder::offset();
+
+        while (!_stats.last_frame) {
+            scene::process_frame();
+        }
+
+        _stats.byte_count += scene::decoder::offset() - start_offset;
+    }
+}
+
+static void _replay_emitter(uint32_t replay_count) {
+    for (uint32_t replay = 0; replay < replay_count; replay++) {
+        scene::seek(_start_frame, _emitter);
+
+        _stats.last_frame = false;
+
+        const uint32_t start_offset = scene::decoder::offset();
+
+        while (!_stats.last_frame) {
+            scene::process_frame(_emitter);
+        }
+
+        _stats.byte_count += scene::decoder::offset() - start_offset;
+    }
+}
+
+static void _report(const char* mode, void (*replay)(uint32_t),
+                    uint32_t replay_count) {
+    _stats = bench_stats();
+
+    const double start_time = _time_get();
+
+    replay(replay_count);
+
+    const double elapsed_time = _time_get() - start_time;
+
+    const uint32_t frame_count = _stats.frame_count / replay_count;
+    printf("\n[%s]\n", mode);
+    printf("frames/replay:     %u\n", frame_count);
+    printf("polygons/frame:    %.2f avg, %u max\n",
+           _stats.polygon_count / static_cast<double>(_stats.frame_count),
+           _stats.max_polygon_count);
+    printf("vertices/frame:    %.2f avg\n",
+           _stats.vertex_count / static_cast<double>(_stats.frame_count));
+    printf("transforms/frame:  %.2f avg\n",
+           _stats.transform_count / static_cast<double>(_stats.frame_count));
+    printf("commands/frame:    %.2f avg\n",
+           _stats.cmdt_count / static_cast<double>(_stats.frame_count));
+    printf("palette writes:    %u/replay\n", _stats.palette_count / replay_count);
+    printf("elapsed:           %.3f ms\n", elapsed_time * 1000.0);
+    printf("frames/sec:        %.0f\n", _stats.frame_count / elapsed_time);
+    printf("bytes parsed/sec:  %.2f MiB/s\n",
+           (_stats.byte_count / elapsed_time) / (1024.0 * 1024.0));
+}
+
+static uint8_t* _file_read(const char* path, size_t& size) {
+    FILE* const fp = fopen(path, "rb");
+
+    if (fp == nullptr) {
+        return nullptr;
+    }
+
+    (void)fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    (void)fseek(fp, 0, SEEK_SET);
+
+    uint8_t* const buffer = static_cast<uint8_t*>(malloc(size));
+    assert(buffer != nullptr);
+
+    if ((fread(buffer, 1, size, fp)) != size) {
+        free(buffer);
+
+        (void)fclose(fp);
+
+        return nullptr;
+    }
+
+    (void)fclose(fp);
+
+    return buffer;
+}
+
+static double _time_get(void) {
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void _on_start(uint32_t, bool) {
+    _stats.frame_polygon_count = 0;
+}
+
+static void _on_end(uint32_t, bool last_frame) {
+    _stats.frame_count++;
+
+    if (_stats.frame_polygon_count > _stats.max_polygon_count) {
+        _stats.max_polygon_count = _stats.frame_polygon_count;
+    }
+
+    _stats.last_frame = last_frame;
+}
+
+static void _on_update_palette(uint8_t, const scene::rgb444) {
+    _stats.palette_count++;
+}
+
+static void _on_transform(int16_vec2_t*, const size_t count) {
+    _stats.transform_count += count;
+}
+
+static void _on_draw(int16_vec2_t const *, const size_t count, const uint8_t) {
+    _stats.frame_polygon_count++;
+    _stats.polygon_count++;
+    _stats.vertex_count += count;
+
+    // Same quad fan as the player
+    if (count >= 3) {
+        _stats.cmdt_count += (count - 1) / 2;
+    }
+}
+
+inline void bench_emitter::on_start(uint32_t frame_index, bool first_frame) {
+    _on_start(frame_index, first_frame);
+}
+
+inline void bench_emitter::on_end(uint32_t frame_index, bool last_frame) {
+    _on_end(frame_index, last_frame);
+}
+
+inline void bench_emitter::on_update_palette(uint8_t palette_index,
+                                             const scene::rgb444 color) {
+    _on_update_palette(palette_index, color);
+}
+
+inline void bench_emitter::on_transform(int16_vec2_t* vertex_buffer,
+                                        const size_t count) {
+    _on_transform(vertex_buffer, count);
+}
+
+inline void bench_emitter::on_draw(int16_vec2_t const * vertex_buffer,
+                                   const size_t count,
+                                   const uint8_t palette_index) {
+    _on_draw(vertex_buffer, count, palette_index);
+}
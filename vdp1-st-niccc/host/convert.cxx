@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "cmd_stream.h"
+#include "scene.h"
+
+// Converts SCENE.BIN into a precompiled command stream (see cmd_stream.h)
+//
+//   scene-convert [-f first-frame] [-n frame-count] SCENE.BIN SCENE.CMD
+//
+// The whole 1800 frame scene converts to ~3 MiB. Use -f/-n to convert a
+// subrange that fits in the romdisk
+
+static constexpr uint16_t _cmdt_ctrl_polygon = 0x0004;
+static constexpr uint16_t _cmdt_ctrl_end = 0x8000;
+static constexpr uint16_t _cmdt_pmod_pre_clipping_disable = 0x0800;
+static constexpr uint16_t _cmdt_colr_palette_base = 0x10;
+
+struct convert_emitter {
+    uint16_t palette[scene::decoder::palette_count];
+    uint16_t palette_dirty_mask;
+    uint16_t flags;
+    std::vector<uint8_t> cmdts;
+
+    inline void on_start(uint32_t, bool) {
+        palette_dirty_mask = 0x0000;
+        flags = 0x0000;
+        cmdts.clear();
+    }
+
+    inline void on_end(uint32_t, bool last_frame) {
+        if (last_frame) {
+            flags |= cmd_stream::FRAME_LAST;
+        }
+    }
+
+    inline void on_update_palette(uint8_t palette_index,
+                                  const scene::rgb444 color) {
+        // Same scaling as the player
+        const uint16_t r = (color.r << 2) & 0x1F;
+        const uint16_t g = (color.g << 2) & 0x1F;
+        const uint16_t b = (color.b << 2) & 0x1F;
+
+        palette[palette_index] = 0x8000 | (b << 10) | (g << 5) | r;
+    }
+
+    inline void on_palette_changed(uint16_t changed_mask) {
+        palette_dirty_mask |= changed_mask;
+    }
+
+    inline void on_clear_screen(bool clear_screen) {
+        if (clear_screen) {
+            flags |= cmd_stream::FRAME_CLEAR_SCREEN;
+        }
+    }
+
+    // Coordinates are kept at 256x200
+    inline void on_transform(int16_vec2_t*, const size_t) { }
+
+    inline void on_draw(int16_vec2_t const * vertex_buffer,
+                        const size_t count,
+                        const uint8_t palette_index);
+
+private:
+    void _cmdt_push(uint16_t ctrl, uint16_t pmod, uint16_t colr,
+                    int16_vec2_t const * const (&vertices)[4]);
+};
+
+static void _write16(std::vector<uint8_t>& buffer, uint16_t value);
+static void _write32(std::vector<uint8_t>& buffer, uint32_t value);
+static void _pad(std::vector<uint8_t>& buffer);
+
+static void _frame_write(std::vector<uint8_t>& buffer,
+                         const convert_emitter& emitter);
+
+static uint8_t* _file_read(const char* path, size_t& size);
+
+static void _usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-f first-frame] [-n frame-count] input output\n",
+            program);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t first_frame = 0;
+    uint32_t frame_count = scene::decoder::frame_count;
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:n:")) != -1) {
+        switch (opt) {
+        case 'f':
+            first_frame = strtoul(optarg, nullptr, 0);
+            break;
+        case 'n':
+            frame_count = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            _usage(argv[0]);
+
+            return 1;
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        _usage(argv[0]);
+
+        return 1;
+    }
+
+    const char* const input_path = argv[optind];
+    const char* const output_path = argv[optind + 1];
+
+    size_t size;
+    uint8_t* const buffer = _file_read(input_path, size);
+
+    if (buffer == nullptr) {
+        fprintf(stderr, "Unable to read %s\n", input_path);
+
+        return 1;
+    }
+
+    const uint8_t* scene_buffer = buffer;
+
+    scene::init(scene_buffer, size);
+
+    convert_emitter emitter;
+    (void)memset(emitter.palette, 0x00, sizeof(emitter.palette));
+
+    std::vector<uint8_t> output(sizeof(cmd_stream::header), 0x00);
+
+    uint32_t frame_index = 0;
+    uint32_t converted_count = 0;
+    bool last_frame = false;
+
+    while (!last_frame && (converted_count < frame_count)) {
+        scene::process_frame(emitter);
+
+        last_frame = (emitter.flags & cmd_stream::FRAME_LAST) != 0;
+
+        if (frame_index >= first_frame) {
+            // Palette state is cumulative, so the first converted frame has
+            // to carry the whole palette
+            if (converted_count == 0) {
+                emitter.palette_dirty_mask = 0xFFFF;
+            }
+
+            // Make sure the player wraps around at the end of a subrange
+            if ((converted_count + 1) == frame_count) {
+                emitter.flags |= cmd_stream::FRAME_LAST;
+            }
+
+            _frame_write(output, emitter);
+
+            converted_count++;
+        }
+
+        frame_index++;
+    }
+
+    if (converted_count == 0) {
+        fprintf(stderr, "No frames converted\n");
+
+        free(buffer);
+
+        return 1;
+    }
+
+    std::vector<uint8_t> header;
+
+    header.insert(header.end(),
+                  cmd_stream::signature,
+                  cmd_stream::signature + sizeof(cmd_stream::signature));
+    _write16(header, cmd_stream::version);
+    _write16(header, converted_count);
+    _write32(header, output.size());
+
+    (void)memcpy(&output[0], &header[0], header.size());
+
+    FILE* const fp = fopen(output_path, "wb");
+
+    if (fp == nullptr) {
+        fprintf(stderr, "Unable to open %s\n", output_path);
+
+        free(buffer);
+
+        return 1;
+    }
+
+    (void)fwrite(&output[0], 1, output.size(), fp);
+    (void)fclose(fp);
+
+    printf("%s: %u frames (%u..%u), %zu bytes\n",
+           output_path, converted_count, first_frame,
+           first_frame + converted_count - 1, output.size());
+
+    free(buffer);
+
+    return 0;
+}
+
+inline void convert_emitter::on_draw(int16_vec2_t const * vertex_buffer,
+                                     const size_t count,
+                                     const uint8_t palette_index) {
+    if (count < 3) {
+        return;
+    }
+
+    const uint16_t colr = _cmdt_colr_palette_base + palette_index;
+
+    // Same quad fan as the player
+    for (uint32_t i = 1; i < (count - 1); i += 2) {
+        const uint32_t d = ((i + 2) < count) ? (i + 2) : (i + 1);
+
+        int16_vec2_t const * const vertices[4] = {
+            &vertex_buffer[0],
+            &vertex_buffer[i],
+            &vertex_buffer[i + 1],
+            &vertex_buffer[d]
+        };
+
+        _cmdt_push(_cmdt_ctrl_polygon, _cmdt_pmod_pre_clipping_disable, colr,
+                   vertices);
+    }
+}
+
+void convert_emitter::_cmdt_push(uint16_t ctrl, uint16_t pmod, uint16_t colr,
+                                 int16_vec2_t const * const (&vertices)[4]) {
+    _write16(cmdts, ctrl);
+    _write16(cmdts, 0x0000); // CMDLINK
+    _write16(cmdts, pmod);
+    _write16(cmdts, colr);
+    _write16(cmdts, 0x0000); // CMDSRCA
+    _write16(cmdts, 0x0000); // CMDSIZE
+
+    for (uint32_t i = 0; i < 4; i++) {
+        _write16(cmdts, vertices[i]->x);
+        _write16(cmdts, vertices[i]->y);
+    }
+
+    _write16(cmdts, 0x0000); // CMDGRDA
+    _write16(cmdts, 0x0000); // Reserved
+}
+
+static void _write16(std::vector<uint8_t>& buffer, uint16_t value) {
+    buffer.push_back(value >> 8);
+    buffer.push_back(value & 0xFF);
+}
+
+static void _write32(std::vector<uint8_t>& buffer, uint32_t value) {
+    _write16(buffer, value >> 16);
+    _write16(buffer, value & 0xFFFF);
+}
+
+static void _pad(std::vector<uint8_t>& buffer) {
+    buffer.resize(cmd_stream::align(buffer.size()), 0x00);
+}
+
+static void _frame_write(std::vector<uint8_t>& buffer,
+                         const convert_emitter& emitter) {
+    const size_t frame_offset = buffer.size();
+    const uint16_t mask = emitter.palette_dirty_mask;
+
+    uint8_t palette_first = 0;
+    uint8_t palette_count = 0;
+
+    // Dirty range, so that the CRAM update is a single transfer
+    if (mask != 0x0000) {
+        palette_first = __builtin_ctz(mask);
+        palette_count = (32 - __builtin_clz(mask)) - palette_first;
+    }
+
+    const uint16_t cmdt_count = (emitter.cmdts.size() / cmd_stream::cmdt_size) + 1;
+
+    _write16(buffer, emitter.flags);
+    _write16(buffer, cmdt_count);
+    buffer.push_back(palette_first);
+    buffer.push_back(palette_count);
+    _write16(buffer, 0x0000);
+    _write32(buffer, 0x00000000); // Size, patched below
+    _write32(buffer, 0x00000000);
+
+    for (uint32_t i = 0; i < palette_count; i++) {
+        _write16(buffer, emitter.palette[palette_first + i]);
+    }
+
+    _pad(buffer);
+
+    assert((buffer.size() - frame_offset) == cmd_stream::cmdts_offset(palette_count));
+
+    buffer.insert(buffer.end(), emitter.cmdts.begin(), emitter.cmdts.end());
+
+    // Draw end
+    _write16(buffer, _cmdt_ctrl_end);
+    buffer.resize(buffer.size() + (cmd_stream::cmdt_size - sizeof(uint16_t)), 0x00);
+
+    const uint32_t frame_size = buffer.size() - frame_offset;
+
+    buffer[frame_offset + 8] = (frame_size >> 24) & 0xFF;
+    buffer[frame_offset + 9] = (frame_size >> 16) & 0xFF;
+    buffer[frame_offset + 10] = (frame_size >> 8) & 0xFF;
+    buffer[frame_offset + 11] = frame_size & 0xFF;
+}
+
+static uint8_t* _file_read(const char* path, size_t& size) {
+    FILE* const fp = fopen(path, "rb");
+
+    if (fp == nullptr) {
+        return nullptr;
+    }
+
+    (void)fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    (void)fseek(fp, 0, SEEK_SET);
+
+    uint8_t* const buffer = static_cast<uint8_t*>(malloc(size));
+    assert(buffer != nullptr);
+
+    if ((fread(buffer, 1, size, fp)) != size) {
+        free(buffer);
+
+        (void)fclose(fp);
+
+        return nullptr;
+    }
+
+    (void)fclose(fp);
+
+    return buffer;
+}
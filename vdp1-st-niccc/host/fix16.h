@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+/* Host stand-in for <fix16.h>. Only what scene.h/scene.cxx need is
+ * provided so that the decoder can be built and profiled off-target */
+
+#ifndef HOST_FIX16_H_
+#define HOST_FIX16_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int32_t fix16_t;
+
+#define FIX16(x) ((fix16_t)(((x) >= 0)                                        \
+        ? ((x) * 65536.0f + 0.5f)                                              \
+        : ((x) * 65536.0f - 0.5f)))
+
+typedef struct int16_vec2 {
+        int16_t x;
+        int16_t y;
+} int16_vec2_t;
+
+#define INT16_VEC2_INITIALIZER(_x, _y)                                         \
+{                                                                              \
+        (_x),                                                                  \
+        (_y)                                                                   \
+}
+
+#endif /* !HOST_FIX16_H_ */
@@ -7,200 +7,357 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 
 #include "scene.h"
 
-struct frame_flags {
-    unsigned int :5;
-    unsigned int index_mode:1;
-    unsigned int contains_palette_data:1;
-    unsigned int clear_screen:1;
-} __attribute__ ((packed));
-
-struct uint8_vector {
-    uint8_t x;
-    uint8_t y;
-} __attribute__ ((packed));
-
-enum polygon_descriptor_flags {
-    FRAME_END = -1,
-    FRAME_END_STREAM_SKIP = -2,
-    STREAM_END = -3
-} __attribute__ ((packed));
-
-union polygon_descriptor {
-    struct {
-        unsigned int palette_index:4;
-        unsigned int vertex_count:4;
-    } __attribute__ ((packed)) encoded;
-
-    polygon_descriptor_flags flag;
-} __attribute__ ((packed));
-
-static_assert(sizeof(frame_flags) == 1);
-static_assert(sizeof(polygon_descriptor) == 1);
-
-static_assert(sizeof(uint8_vector) == 2);
-
-static constexpr uint32_t _frame_count = 1800;
-static constexpr size_t _chunk_size = 64 * 1024; // 64 KiB chunk
-static constexpr size_t _buffer_size = _frame_count * _chunk_size;
-static constexpr uint32_t _palette_count = 16;
-static constexpr size_t _vertex_buffer_size = 256;
-static constexpr size_t _polygon_vertex_buffer_size = 16;
-
-static const uint8_t* _buffer = nullptr;
-static uint32_t _offset = 0;
-static uint32_t _chunk_index = 0;
-static uint32_t _frame_index = 0;
-static uint8_vector* _indexed_vertex_buffer;
-static int16_vec2_t* _vertex_buffer;
-
-static scene::start_handler _on_start;
-static scene::end_handler _on_end;
-static scene::update_palette_handler _on_update_palette;
-static scene::clear_screen_handler _on_clear_screen;
-static scene::draw_handler _on_draw;
-
-static void _align(void);
+using namespace scene::decoder;
+
+// Adapts the callbacks to the emitter interface expected by
+// scene::process_frame<T>()
+struct callback_emitter {
+    scene::start_handler on_start;
+    scene::end_handler on_end;
+    scene::update_palette_handler on_update_palette;
+    scene::palette_changed_handler on_palette_changed;
+    scene::clear_screen_handler on_clear_screen;
+    scene::transform_handler on_transform;
+    scene::draw_handler on_draw;
+};
+
+scene::decoder::state scene::decoder::current;
+
+static callback_emitter _callback_emitter;
+
+static const uint8_t* _buffer;
+
+// Unbounded when streaming through a chunk handler
+static size_t _size = SIZE_MAX;
+
+static const scene::callbacks _null_callbacks = {
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
 
 static void _palette_init(void);
-static void _palette_update(void);
-static uint32_t _palette_indices_get(int8_t(& palette_indices)[_palette_count]);
 
 static void _vertex_buffer_init(void);
-static void _indexed_vertex_buffer_get(void);
-static uint8_t _vertex_buffer_indexed_get(const polygon_descriptor polygon_descriptor);
-static uint8_t _vertex_buffer_get(const polygon_descriptor polygon_descriptor);
 
-template<typename T>
-static inline const T _read(void) {
-    const auto buffer_ptr = &_buffer[_offset];
-    const T* ptr_value = reinterpret_cast<const T*>(buffer_ptr);
+static bool _stream_truncated(uint32_t byte_count);
 
-    _offset++;
-
-    return *ptr_value;
+void scene::init(const uint8_t*& buffer, size_t size) {
+    init(buffer, size, _null_callbacks);
 }
 
-void scene::init(const uint8_t*& buffer, const callbacks& callbacks) {
+void scene::init(const uint8_t*& buffer, size_t size, const callbacks& callbacks) {
     _buffer = buffer;
 
-    _on_start = ((callbacks.on_start != nullptr)
-                 ? callbacks.on_start
-                 : [] (uint32_t, bool) { });
+    init([] (uint32_t chunk_index) {
+             return &_buffer[chunk_size * chunk_index];
+         },
+         callbacks);
 
-    _on_end = ((callbacks.on_end != nullptr)
-               ? callbacks.on_end
-               : [] (uint32_t, bool) { });
+    _size = size;
+}
 
-    _on_update_palette = ((callbacks.on_update_palette != nullptr)
-                          ? callbacks.on_update_palette
-                          : [] (uint8_t, const rgb444) { });
+void scene::init(chunk_handler chunk_get) {
+    init(chunk_get, _null_callbacks);
+}
 
-    _on_clear_screen = ((callbacks.on_clear_screen != nullptr)
-                        ? callbacks.on_clear_screen
-                        : [] (bool) { });
+void scene::init(chunk_handler chunk_get, const callbacks& callbacks) {
+    current.chunk_get = chunk_get;
+    _size = SIZE_MAX;
 
-    _on_draw = ((callbacks.on_draw != nullptr)
-                ? callbacks.on_draw
-                : [] (int16_vec2_t const*, size_t, uint8_t) { });
+    _callback_emitter.on_start = ((callbacks.on_start != nullptr)
+                                  ? callbacks.on_start
+                                  : [] (uint32_t, bool) { });
+
+    _callback_emitter.on_end = ((callbacks.on_end != nullptr)
+                                ? callbacks.on_end
+                                : [] (uint32_t, bool) { });
+
+    _callback_emitter.on_update_palette = ((callbacks.on_update_palette != nullptr)
+                                           ? callbacks.on_update_palette
+                                           : [] (uint8_t, const rgb444) { });
+
+    _callback_emitter.on_palette_changed = ((callbacks.on_palette_changed != nullptr)
+                                            ? callbacks.on_palette_changed
+                                            : [] (uint16_t) { });
+
+    _callback_emitter.on_clear_screen = ((callbacks.on_clear_screen != nullptr)
+                                         ? callbacks.on_clear_screen
+                                         : [] (bool) { });
+
+    _callback_emitter.on_transform = ((callbacks.on_transform != nullptr)
+                                      ? callbacks.on_transform
+                                      : [] (int16_vec2_t*, size_t) { });
+
+    _callback_emitter.on_draw = ((callbacks.on_draw != nullptr)
+                                 ? callbacks.on_draw
+                                 : [] (int16_vec2_t const*, size_t, uint8_t) { });
 
-    _palette_init();
     _vertex_buffer_init();
 
     reset();
 }
 
 void scene::reset(void) {
-    _offset = 0;
-    _chunk_index = 0;
-    _frame_index = 0;
+    chunk_load(0);
+    current.frame_index = 0;
+
+    _palette_init();
 }
 
-void scene::process_frame(void) {
-    _on_start(_frame_index, _offset == 0);
+void scene::index_build(void) {
+    if (current.keyframes == nullptr) {
+        constexpr uint32_t keyframe_count =
+            (decoder::frame_count + keyframe_interval - 1) / keyframe_interval;
 
-    auto frame_flags = _read<::frame_flags>();
+        current.keyframes = new keyframe[keyframe_count];
+        assert(current.keyframes != nullptr);
+    }
+
+    reset();
 
-    _on_clear_screen(frame_flags.clear_screen);
+    null_emitter skip_emitter;
+    skip_emitter.last_frame = false;
 
-    if (frame_flags.contains_palette_data) {
-        _palette_update();
-    }
+    current.keyframe_count = 0;
+
+    while (!skip_emitter.last_frame) {
+        if ((current.frame_index % keyframe_interval) == 0) {
+            assert(current.frame_index < decoder::frame_count);
+
+            keyframe& keyframe = current.keyframes[current.keyframe_count];
+
+            keyframe.offset = current.stream.offset();
+            keyframe.chunk_index = current.chunk_index;
+
+            for (uint32_t i = 0; i < palette_count; i++) {
+                keyframe.palette[i] = current.palette[i];
+            }
+
+            current.keyframe_count++;
+        }
 
-    if (frame_flags.index_mode) {
-        _indexed_vertex_buffer_get();
+        process_frame(skip_emitter);
     }
 
+    current.indexed_frame_count = current.frame_index;
+
+    reset();
+}
+
+void scene::validate(validation& result) {
+    result.valid = false;
+    result.error = nullptr;
+    result.frame_count = 0;
+    result.max_polygon_count = 0;
+    result.max_quad_count = 0;
+
+    reset();
+
     while (true) {
-        auto polygon_descriptor = _read<::polygon_descriptor>();
+        result.frame_index = current.frame_index;
+        result.offset = offset();
 
-        if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END) {
-            _on_end(_frame_index, false);
+        if (current.frame_index >= decoder::frame_count) {
+            result.error = "Too many frames";
 
             break;
-        } else if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END_STREAM_SKIP) {
-            _on_end(_frame_index, false);
-            _align();
+        }
+
+        if (_stream_truncated(sizeof(uint8_t))) {
+            result.error = "Truncated stream";
 
             break;
-        } else if (polygon_descriptor.flag == polygon_descriptor_flags::STREAM_END) {
-            _on_end(_frame_index, true);
+        }
+
+        const uint8_t flags = current.stream.read_u8();
+
+        // Only the lower 3 bits are defined
+        if ((flags & 0xF8) != 0x00) {
+            result.error = "Invalid frame flags";
 
             break;
-        } else {
-            uint8_t vertex_count;
+        }
+
+        auto frame_flags = *reinterpret_cast<const decoder::frame_flags*>(&flags);
+
+        if (frame_flags.contains_palette_data) {
+            if (_stream_truncated(sizeof(uint16_t))) {
+                result.error = "Truncated stream";
+
+                break;
+            }
+
+            int8_t palette_indices[palette_count];
+            const uint32_t palette_index_count = palette_indices_get(palette_indices);
+
+            if (_stream_truncated(palette_index_count * sizeof(uint16_t))) {
+                result.error = "Truncated stream";
+
+                break;
+            }
+
+            current.stream.seek(current.stream.offset() + (palette_index_count * sizeof(uint16_t)));
+        }
+
+        uint32_t indexed_vertex_count = 0;
+
+        if (frame_flags.index_mode) {
+            if (_stream_truncated(sizeof(uint8_t))) {
+                result.error = "Truncated stream";
+
+                break;
+            }
+
+            indexed_vertex_count = current.stream.read_u8();
+
+            if (_stream_truncated(indexed_vertex_count * 2)) {
+                result.error = "Truncated stream";
+
+                break;
+            }
+
+            current.stream.seek(current.stream.offset() + (indexed_vertex_count * 2));
+        }
+
+        uint32_t polygon_count = 0;
+        uint32_t quad_count = 0;
+
+        bool frame_end = false;
+        bool stream_end = false;
+
+        while (!frame_end) {
+            result.offset = offset();
+
+            if (current.stream.offset() >= chunk_size) {
+                result.error = "Frame crosses a chunk boundary";
+
+                break;
+            }
+
+            if (_stream_truncated(sizeof(decoder::polygon_descriptor))) {
+                result.error = "Truncated stream";
+
+                break;
+            }
+
+            auto polygon_descriptor = current.stream.read<decoder::polygon_descriptor>();
+
+            if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END) {
+                frame_end = true;
+            } else if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END_STREAM_SKIP) {
+                // The next frame starts at the next chunk
+                if ((chunk_size * (current.chunk_index + 1)) >= _size) {
+                    result.error = "Truncated stream";
+
+                    break;
+                }
 
-            if (frame_flags.index_mode) {
-                vertex_count = _vertex_buffer_indexed_get(polygon_descriptor);
+                align();
+
+                frame_end = true;
+            } else if (polygon_descriptor.flag == polygon_descriptor_flags::STREAM_END) {
+                frame_end = true;
+                stream_end = true;
             } else {
-                vertex_count = _vertex_buffer_get(polygon_descriptor);
+                const uint32_t vertex_count = polygon_descriptor.encoded.vertex_count;
+
+                if (vertex_count < 3) {
+                    result.error = "Polygon with fewer than 3 vertices";
+
+                    break;
+                }
+
+                // Either a byte index or a pair of byte coordinates per vertex
+                const uint32_t vertex_size = (frame_flags.index_mode) ? 1 : 2;
+
+                if (_stream_truncated(vertex_count * vertex_size)) {
+                    result.error = "Truncated stream";
+
+                    break;
+                }
+
+                if (frame_flags.index_mode) {
+                    for (uint32_t i = 0; i < vertex_count; i++) {
+                        if (current.stream.read_u8() >= indexed_vertex_count) {
+                            result.error = "Vertex index out of range";
+
+                            break;
+                        }
+                    }
+
+                    if (result.error != nullptr) {
+                        break;
+                    }
+                } else {
+                    current.stream.seek(current.stream.offset() + (vertex_count * vertex_size));
+                }
+
+                polygon_count++;
+                quad_count += (vertex_count - 1) / 2;
             }
+        }
 
-            uint8_t palette_index = polygon_descriptor.encoded.palette_index;
+        if (result.error != nullptr) {
+            break;
+        }
 
-            _on_draw(_vertex_buffer, vertex_count, palette_index);
+        if (polygon_count > result.max_polygon_count) {
+            result.max_polygon_count = polygon_count;
         }
-    }
 
-    _frame_index++;
-}
+        if (quad_count > result.max_quad_count) {
+            result.max_quad_count = quad_count;
+        }
 
-static void _align(void) {
-    _chunk_index++;
-    _offset = _chunk_size * _chunk_index;
-}
+        current.frame_index++;
 
-static void _palette_init(void) {
+        if (stream_end) {
+            result.valid = true;
+            result.frame_count = current.frame_index;
+
+            break;
+        }
+    }
+
+    reset();
 }
 
-static void _palette_update(void) {
-    int8_t palette_indices[_palette_count];
-    const uint32_t palette_index_count = _palette_indices_get(palette_indices);
+uint32_t scene::frame_count(void) {
+    assert(current.keyframes != nullptr);
 
-    for (uint32_t offset = 0; offset < palette_index_count; offset++) {
-        const uint8_t palette_index = palette_indices[offset];
+    return current.indexed_frame_count;
+}
 
-        const uint8_t high_nybble = _read<uint8_t>();
-        const uint8_t low_nybble = _read<uint8_t>();
+void scene::process_frame(void) {
+    process_frame(_callback_emitter);
+}
 
-        scene::rgb444 rgb;
+void scene::seek(uint32_t frame_index) {
+    seek(frame_index, _callback_emitter);
+}
 
-        rgb.r = high_nybble & 0x0F;
-        rgb.g = (low_nybble >> 4) & 0x0F;
-        rgb.b = low_nybble & 0x0F;
+void scene::decoder::chunk_load(uint32_t chunk_index) {
+    current.chunk_index = chunk_index;
+    current.stream.init(current.chunk_get(chunk_index));
+}
 
-        _on_update_palette(palette_index, rgb);
-    }
+void scene::decoder::align(void) {
+    chunk_load(current.chunk_index + 1);
 }
 
-static uint32_t _palette_indices_get(int8_t(& palette_indices)[_palette_count]) {
-    const uint8_t high_nybble = _read<uint8_t>();
-    const uint8_t low_nybble = _read<uint8_t>();
-    const uint16_t mask = (high_nybble << 8) | low_nybble;
+uint32_t scene::decoder::palette_indices_get(int8_t(& palette_indices)[palette_count]) {
+    const uint16_t mask = current.stream.read_u16();
 
-    for (uint32_t index = 0; index < _palette_count; index++) {
+    for (uint32_t index = 0; index < palette_count; index++) {
         palette_indices[index] = -1;
     }
 
@@ -219,50 +376,29 @@ static uint32_t _palette_indices_get(int8_t(& palette_indices)[_palette_count])
     return palette_index;
 }
 
-static void _vertex_buffer_init(void) {
-    _indexed_vertex_buffer =  new uint8_vector[_vertex_buffer_size];
-    assert(_indexed_vertex_buffer != nullptr);
-
-    _vertex_buffer = new int16_vec2_t[_polygon_vertex_buffer_size];
-    assert(_vertex_buffer != nullptr);
-}
+uint32_t scene::decoder::indexed_vertex_buffer_get(void) {
+    const uint8_t vertex_count = current.stream.read_u8();
 
-static void _indexed_vertex_buffer_get(void) {
-    uint8_t vertex_count = _read<uint8_t>();
+    current.stream.vertices_read(current.indexed_vertex_buffer, vertex_count);
 
-    for (uint8_t i = 0; i < vertex_count; i++) {
-        const uint8_t x = _read<uint8_t>();
-        const uint8_t y = _read<uint8_t>();
+    return vertex_count;
+}
 
-        _indexed_vertex_buffer[i].x = x;
-        _indexed_vertex_buffer[i].y = y;
+static void _palette_init(void) {
+    for (uint32_t i = 0; i < palette_count; i++) {
+        current.palette[i].value = 0x0000;
     }
 }
 
-static uint8_t _vertex_buffer_indexed_get(const polygon_descriptor polygon_descriptor) {
-    const uint8_t vertex_count = polygon_descriptor.encoded.vertex_count;
-
-    for (uint8_t i = 0; i < vertex_count; i++) {
-        const uint8_t vertex_index = _read<uint8_t>();
-        const uint8_vector& vertex = _indexed_vertex_buffer[vertex_index];
-
-        _vertex_buffer[i].x = vertex.x;
-        _vertex_buffer[i].y = vertex.y;
+static void _vertex_buffer_init(void) {
+    if (current.indexed_vertex_buffer != nullptr) {
+        return;
     }
 
-    return vertex_count;
+    current.indexed_vertex_buffer = new int16_vec2_t[vertex_buffer_size];
+    assert(current.indexed_vertex_buffer != nullptr);
 }
 
-static uint8_t _vertex_buffer_get(const polygon_descriptor polygon_descriptor) {
-    const uint8_t vertex_count = polygon_descriptor.encoded.vertex_count;
-
-    for (uint8_t i = 0; i < vertex_count; i++) {
-        const uint8_t x = _read<uint8_t>();
-        const uint8_t y = _read<uint8_t>();
-
-        _vertex_buffer[i].x = x;
-        _vertex_buffer[i].y = y;
-    }
-
-    return vertex_count;
+static bool _stream_truncated(uint32_t byte_count) {
+    return ((offset() + byte_count) > _size);
 }
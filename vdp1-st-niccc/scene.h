@@ -23,23 +23,90 @@ namespace scene {
     typedef void (*end_handler)(uint32_t frame_index, bool last_frame);
     typedef void (*update_palette_handler)(uint8_t palette_index,
                                            const rgb444 color);
+    // Called once per frame that carries palette data, after the individual
+    // on_update_palette() calls. Bit n of changed_mask is set if palette
+    // entry n changed
+    typedef void (*palette_changed_handler)(uint16_t changed_mask);
     typedef void (*clear_screen_handler)(bool clear_screen);
+    // Transforms vertices in place (i.e. into screen space) before they're
+    // passed to on_draw(). In index mode, it's called once per frame on the
+    // shared vertex pool rather than on each polygon's vertices
+    typedef void (*transform_handler)(int16_vec2_t* vertex_buffer,
+                                      const size_t count);
     typedef void (*draw_handler)(int16_vec2_t const* vertex_buffer,
                                  const size_t count,
                                  const uint8_t palette_index);
 
+    // Returns a pointer to the decoder::chunk_size bytes of chunk
+    // chunk_index. The decoder only moves on to the next chunk, or back to
+    // the start of the stream (chunk 0), so a streaming source only needs to
+    // keep the chunk currently being decoded around
+    typedef const uint8_t* (*chunk_handler)(uint32_t chunk_index);
+
     struct callbacks {
         start_handler on_start;
         end_handler on_end;
         update_palette_handler on_update_palette;
+        palette_changed_handler on_palette_changed;
         clear_screen_handler on_clear_screen;
+        transform_handler on_transform;
         draw_handler on_draw;
     };
 
-    void init(const uint8_t*& buffer, const callbacks& callbacks);
+    // Result of validate(). If valid is false, error describes the first
+    // problem found, and frame_index and offset locate it
+    struct validation {
+        bool valid;
+        const char* error;
+        uint32_t frame_index;
+        uint32_t offset;
+
+        uint32_t frame_count;
+        // Per frame maximums. Drawn as a quad fan, a polygon of n vertices
+        // takes (n - 1) / 2 quads
+        uint32_t max_polygon_count;
+        uint32_t max_quad_count;
+    };
+
+    // The whole stream in memory, size bytes long
+    void init(const uint8_t*& buffer, size_t size);
+    void init(const uint8_t*& buffer, size_t size, const callbacks& callbacks);
+    void init(chunk_handler chunk_get);
+    void init(chunk_handler chunk_get, const callbacks& callbacks);
     void reset(void);
 
+    // Walks the whole stream checking every descriptor against the format's
+    // bounds, without decoding or drawing anything. When the stream was
+    // passed in memory, every read is also checked against its size. The
+    // decoder is reset afterwards
+    void validate(validation& result);
+
+    // One-time pass over the whole stream that records a keyframe (offset,
+    // chunk and palette) every decoder::keyframe_interval frames. Required
+    // by frame_count() and seek()
+    void index_build(void);
+    uint32_t frame_count(void);
+
+    // Decodes a frame, dispatching through the callbacks passed to init()
     void process_frame(void);
+
+    // Decodes a frame, dispatching straight into an emitter. The emitter
+    // type must provide the same members as callbacks (on_start, on_end,
+    // on_update_palette, on_palette_changed, on_clear_screen, on_transform
+    // and on_draw);
+    // they are resolved at compile time and inlined into the decoder loop
+    template <typename T>
+    void process_frame(T& emitter);
+
+    // Positions the decoder so that the next process_frame() decodes
+    // frame_index. The palette in effect at that frame is delivered through
+    // on_update_palette() (all entries) and on_palette_changed()
+    void seek(uint32_t frame_index);
+
+    template <typename T>
+    void seek(uint32_t frame_index, T& emitter);
 };
 
+#include "scene_decoder.h"
+
 #endif // SCENE_H_
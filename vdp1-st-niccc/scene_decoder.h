@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef SCENE_DECODER_H_
+#define SCENE_DECODER_H_
+
+#include <assert.h>
+
+#include "stream.h"
+
+// Only to be included by scene.h
+
+namespace scene {
+    namespace decoder {
+        // Bit-fields are allocated MSB first on the SH-2 (big-endian) and
+        // LSB first on little-endian hosts, so the declaration order has to
+        // follow suit
+        struct frame_flags {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            unsigned int :5;
+            unsigned int index_mode:1;
+            unsigned int contains_palette_data:1;
+            unsigned int clear_screen:1;
+#else
+            unsigned int clear_screen:1;
+            unsigned int contains_palette_data:1;
+            unsigned int index_mode:1;
+            unsigned int :5;
+#endif
+        } __attribute__ ((packed));
+
+        enum polygon_descriptor_flags {
+            FRAME_END = -1,
+            FRAME_END_STREAM_SKIP = -2,
+            STREAM_END = -3
+        } __attribute__ ((packed));
+
+        union polygon_descriptor {
+            struct {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                unsigned int palette_index:4;
+                unsigned int vertex_count:4;
+#else
+                unsigned int vertex_count:4;
+                unsigned int palette_index:4;
+#endif
+            } __attribute__ ((packed)) encoded;
+
+            polygon_descriptor_flags flag;
+        } __attribute__ ((packed));
+
+        static_assert(sizeof(frame_flags) == 1);
+        static_assert(sizeof(polygon_descriptor) == 1);
+
+        constexpr uint32_t frame_count = 1800;
+        constexpr size_t chunk_size = 64 * 1024; // 64 KiB chunk
+        constexpr uint32_t palette_count = 16;
+        constexpr size_t vertex_buffer_size = 256;
+        constexpr size_t polygon_vertex_buffer_size = 16;
+        constexpr uint32_t keyframe_interval = 16;
+
+        // Everything needed to resume decoding at a given frame
+        struct keyframe {
+            uint32_t offset; // Within chunk_index
+            uint32_t chunk_index;
+            rgb444 palette[palette_count];
+        };
+
+        struct state {
+            // Offsets within the stream are relative to the current chunk
+            stream_reader stream;
+            chunk_handler chunk_get;
+            uint32_t chunk_index;
+            uint32_t frame_index;
+            int16_vec2_t* indexed_vertex_buffer;
+            // Palette state is cumulative across frames, so it's tracked in
+            // order to be able to snapshot it
+            rgb444 palette[palette_count];
+
+            keyframe* keyframes;
+            uint32_t keyframe_count;
+            uint32_t indexed_frame_count;
+        };
+
+        // Discards everything, used to skip over frames
+        struct null_emitter {
+            bool last_frame;
+
+            inline void on_start(uint32_t, bool) { }
+            inline void on_end(uint32_t, bool last) { last_frame = last; }
+            inline void on_update_palette(uint8_t, const rgb444) { }
+            inline void on_palette_changed(uint16_t) { }
+            inline void on_clear_screen(bool) { }
+            inline void on_transform(int16_vec2_t*, const size_t) { }
+            inline void on_draw(int16_vec2_t const*, const size_t, const uint8_t) { }
+        };
+
+        extern state current;
+
+        // Offset from the start of the stream
+        inline uint32_t offset(void) {
+            return (chunk_size * current.chunk_index) + current.stream.offset();
+        }
+
+        void chunk_load(uint32_t chunk_index);
+        void align(void);
+        uint32_t palette_indices_get(int8_t(& palette_indices)[palette_count]);
+        uint32_t indexed_vertex_buffer_get(void);
+
+        template <typename T>
+        inline void palette_update(T& emitter) {
+            int8_t palette_indices[palette_count];
+            const uint32_t palette_index_count = palette_indices_get(palette_indices);
+
+            uint16_t changed_mask = 0x0000;
+
+            for (uint32_t offset = 0; offset < palette_index_count; offset++) {
+                const uint8_t palette_index = palette_indices[offset];
+
+                const uint16_t color = current.stream.read_u16();
+
+                scene::rgb444 rgb;
+
+                rgb.r = (color >> 8) & 0x0F;
+                rgb.g = (color >> 4) & 0x0F;
+                rgb.b = color & 0x0F;
+
+                current.palette[palette_index] = rgb;
+
+                emitter.on_update_palette(palette_index, rgb);
+
+                changed_mask |= 1 << palette_index;
+            }
+
+            emitter.on_palette_changed(changed_mask);
+        }
+
+        inline uint8_t vertex_buffer_indexed_get(const polygon_descriptor polygon_descriptor,
+                                                 int16_vec2_t* vertex_buffer) {
+            const uint8_t vertex_count = polygon_descriptor.encoded.vertex_count;
+
+            for (uint8_t i = 0; i < vertex_count; i++) {
+                const uint8_t vertex_index = current.stream.read_u8();
+
+                vertex_buffer[i] = current.indexed_vertex_buffer[vertex_index];
+            }
+
+            return vertex_count;
+        }
+
+        inline uint8_t vertex_buffer_get(const polygon_descriptor polygon_descriptor,
+                                         int16_vec2_t* vertex_buffer) {
+            const uint8_t vertex_count = polygon_descriptor.encoded.vertex_count;
+
+            current.stream.vertices_read(vertex_buffer, vertex_count);
+
+            return vertex_count;
+        }
+    }
+
+    template <typename T>
+    void process_frame(T& emitter) {
+        using namespace decoder;
+
+        int16_vec2_t vertex_buffer[polygon_vertex_buffer_size];
+
+        emitter.on_start(current.frame_index, current.frame_index == 0);
+
+        auto frame_flags = current.stream.read<decoder::frame_flags>();
+
+        emitter.on_clear_screen(frame_flags.clear_screen);
+
+        if (frame_flags.contains_palette_data) {
+            palette_update(emitter);
+        }
+
+        if (frame_flags.index_mode) {
+            const uint32_t vertex_count = indexed_vertex_buffer_get();
+
+            // Polygons pick up already transformed vertices from the pool
+            emitter.on_transform(current.indexed_vertex_buffer, vertex_count);
+        }
+
+        bool last_frame = false;
+
+        while (true) {
+            auto polygon_descriptor = current.stream.read<decoder::polygon_descriptor>();
+
+            if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END) {
+                break;
+            } else if (polygon_descriptor.flag == polygon_descriptor_flags::FRAME_END_STREAM_SKIP) {
+                align();
+
+                break;
+            } else if (polygon_descriptor.flag == polygon_descriptor_flags::STREAM_END) {
+                last_frame = true;
+
+                break;
+            } else {
+                uint8_t vertex_count;
+
+                if (frame_flags.index_mode) {
+                    vertex_count = vertex_buffer_indexed_get(polygon_descriptor, vertex_buffer);
+                } else {
+                    vertex_count = vertex_buffer_get(polygon_descriptor, vertex_buffer);
+
+                    emitter.on_transform(vertex_buffer, vertex_count);
+                }
+
+                uint8_t palette_index = polygon_descriptor.encoded.palette_index;
+
+                emitter.on_draw(vertex_buffer, vertex_count, palette_index);
+            }
+        }
+
+        // The handler may reset the decoder at the last frame, so the frame
+        // is counted before it's called
+        const uint32_t frame_index = current.frame_index++;
+
+        emitter.on_end(frame_index, last_frame);
+    }
+
+    template <typename T>
+    void seek(uint32_t frame_index, T& emitter) {
+        using namespace decoder;
+
+        assert(current.keyframes != nullptr);
+        assert(frame_index < current.indexed_frame_count);
+
+        const uint32_t keyframe_index = frame_index / keyframe_interval;
+        const keyframe& keyframe = current.keyframes[keyframe_index];
+
+        chunk_load(keyframe.chunk_index);
+        current.stream.seek(keyframe.offset);
+        current.frame_index = keyframe_index * keyframe_interval;
+
+        for (uint32_t i = 0; i < palette_count; i++) {
+            current.palette[i] = keyframe.palette[i];
+        }
+
+        null_emitter skip_emitter;
+
+        while (current.frame_index < frame_index) {
+            process_frame(skip_emitter);
+        }
+
+        for (uint32_t i = 0; i < palette_count; i++) {
+            emitter.on_update_palette(i, current.palette[i]);
+        }
+
+        emitter.on_palette_changed(0xFFFF);
+    }
+};
+
+#endif // SCENE_DECODER_H_
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stdint.h>
+
+#include <fix16.h>
+
+/* Cursor over the big-endian ST-NICCC stream, read in place (i.e. straight
+ * from the romdisk_direct() mapping). Runs of data are pulled in 16-bit and
+ * 32-bit loads whenever the cursor allows it, falling back to byte loads
+ * only for unaligned heads and tails */
+class stream_reader {
+public:
+    void init(const uint8_t* base) {
+        _base = base;
+        _cursor = base;
+    }
+
+    void seek(uint32_t offset) {
+        _cursor = &_base[offset];
+    }
+
+    uint32_t offset(void) const {
+        return static_cast<uint32_t>(_cursor - _base);
+    }
+
+    template<typename T>
+    inline const T read(void) {
+        static_assert(sizeof(T) == 1);
+
+        const T* const ptr_value = reinterpret_cast<const T*>(_cursor);
+
+        _cursor++;
+
+        return *ptr_value;
+    }
+
+    inline uint8_t read_u8(void) {
+        return *_cursor++;
+    }
+
+    inline uint16_t read_u16(void) {
+        uint16_t value;
+
+        if ((_address() & 0x01) == 0) {
+            value = _load16(_cursor);
+        } else {
+            value = (_cursor[0] << 8) | _cursor[1];
+        }
+
+        _cursor += 2;
+
+        return value;
+    }
+
+    /* Reads count packed (x, y) byte pairs */
+    inline void vertices_read(int16_vec2_t* out, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+
+        if ((_address() & 0x01) != 0) {
+            _vertices_odd_read(out, count);
+
+            return;
+        }
+
+        if ((_address() & 0x02) != 0) {
+            _vertex_set(out, _load16(_cursor));
+
+            _cursor += 2;
+            out++;
+            count--;
+        }
+
+        for (; count >= 2; count -= 2) {
+            const uint32_t pair = _load32(_cursor);
+
+            _vertex_set(&out[0], pair >> 16);
+            _vertex_set(&out[1], pair & 0xFFFF);
+
+            _cursor += 4;
+            out += 2;
+        }
+
+        if (count != 0) {
+            _vertex_set(out, _load16(_cursor));
+
+            _cursor += 2;
+        }
+    }
+
+private:
+    typedef uint16_t __attribute__ ((may_alias)) _uint16_alias_t;
+    typedef uint32_t __attribute__ ((may_alias)) _uint32_alias_t;
+
+    const uint8_t* _base;
+    const uint8_t* _cursor;
+
+    inline uintptr_t _address(void) const {
+        return reinterpret_cast<uintptr_t>(_cursor);
+    }
+
+    static inline uint16_t _load16(const uint8_t* ptr) {
+        const uint16_t value = *reinterpret_cast<const _uint16_alias_t*>(ptr);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#else
+        return __builtin_bswap16(value);
+#endif
+    }
+
+    static inline uint32_t _load32(const uint8_t* ptr) {
+        const uint32_t value = *reinterpret_cast<const _uint32_alias_t*>(ptr);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#else
+        return __builtin_bswap32(value);
+#endif
+    }
+
+    static inline void _vertex_set(int16_vec2_t* vertex, uint16_t xy) {
+        vertex->x = xy >> 8;
+        vertex->y = xy & 0xFF;
+    }
+
+    /* The run straddles 16-bit words: the first X is a byte load, then each
+     * word holds the Y of one vertex and the X of the next */
+    inline void _vertices_odd_read(int16_vec2_t* out, uint32_t count) {
+        out[0].x = *_cursor++;
+
+        for (uint32_t i = 0; i < (count - 1); i++) {
+            const uint16_t yx = _load16(_cursor);
+
+            out[i].y = yx >> 8;
+            out[i + 1].x = yx & 0xFF;
+
+            _cursor += 2;
+        }
+
+        out[count - 1].y = *_cursor++;
+    }
+};
+
+#endif // STREAM_H_
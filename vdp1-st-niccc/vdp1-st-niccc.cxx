@@ -9,38 +9,192 @@
 
 #include <yaul.h>
 
+#include "cd_stream.h"
+#include "cmd_stream.h"
 #include "scene.h"
 
 #define ORDER_SYSTEM_CLIP_COORDS_INDEX      0
 #define ORDER_LOCAL_COORDS_INDEX            1
 #define ORDER_BUFFER_STARTING_INDEX         2
-#define ORDER_BUFFER_END_INDEX              (ORDER_BUFFER_STARTING_INDEX + 256)
-#define ORDER_DRAW_END_INDEX                (ORDER_BUFFER_END_INDEX + 1)
-#define ORDER_COUNT                         ORDER_DRAW_END_INDEX
 
-static constexpr uint32_t _screen_width = 320;
-static constexpr uint32_t _screen_height = 240;
+// Prints the frame's command count and dumps the start of VDP1 VRAM every
+// frame. Very slow, so only enable when debugging. dbgio is only used from
+// the master, so this does nothing while the slave decodes
+static constexpr bool _debug_vram_dump = false;
+
+// Prints one line of per frame statistics to the USB cart for every frame
+// submitted, instead of showing the overlay (toggled with A)
+static constexpr bool _stats_usb_cart_dump = false;
+
+// Number of frames the overlay's min/avg/max are computed over
+static constexpr uint32_t _stats_window_size = 64;
+
+// Decode on the slave CPU while the master submits. Set to false to decode
+// on the master for comparison
+static constexpr bool _slave_decode = true;
+
+// Stream SCENE.BIN from CD when it's found on the disc, falling back to the
+// copy in the romdisk otherwise
+static constexpr bool _cd_stream_enable = true;
+
+// Check every descriptor of SCENE.BIN before playing it, and size the
+// command lists after its most complex frame. Not done when streaming from CD
+static constexpr bool _validate_scene = true;
+
+static constexpr uint32_t _frame_slot_count = 3;
+
+// Frames skipped back or forward with LEFT and RIGHT. Only when playing from
+// memory, since a CD stream can only be read forward
+static constexpr uint32_t _seek_frame_step = 64;
+static constexpr uint32_t _seek_none = UINT32_MAX;
+
+// Polygon commands per frame, unless validation says otherwise. The maximum
+// keeps a list (plus the preamble and end commands) within 32 KiB of VDP1
+// VRAM. Polygons past the capacity are dropped and counted
+static constexpr uint32_t _cmdt_capacity_default = 256;
+static constexpr uint32_t _cmdt_capacity_max = 1024 - 3;
 
 static constexpr uint32_t _render_width = 256;
 static constexpr uint32_t _render_height = 200;
 
-static constexpr fix16_t _scale_width = FIX16(_screen_width / static_cast<float>(_render_width));
-static constexpr fix16_t _scale_height = FIX16(_screen_height / static_cast<float>(_render_height));
+/* Output resolutions, cycled through with START. The scene is scaled from
+ * 256x200 to fill the whole screen */
+struct viewport {
+    vdp2_tvmd_interlace_t interlace;
+    vdp2_tvmd_horz_t horz;
+    vdp2_tvmd_vert_t vert;
+    uint16_t width;
+    uint16_t height;
+};
+
+static constexpr viewport _viewports[] = {
+    { VDP2_TVMD_INTERLACE_NONE,   VDP2_TVMD_HORZ_NORMAL_A, VDP2_TVMD_VERT_240, 320, 240 },
+    { VDP2_TVMD_INTERLACE_NONE,   VDP2_TVMD_HORZ_NORMAL_A, VDP2_TVMD_VERT_224, 320, 224 },
+    { VDP2_TVMD_INTERLACE_NONE,   VDP2_TVMD_HORZ_NORMAL_B, VDP2_TVMD_VERT_240, 352, 240 },
+    { VDP2_TVMD_INTERLACE_NONE,   VDP2_TVMD_HORZ_NORMAL_B, VDP2_TVMD_VERT_224, 352, 224 },
+    { VDP2_TVMD_INTERLACE_SINGLE, VDP2_TVMD_HORZ_NORMAL_A, VDP2_TVMD_VERT_240, 320, 240 },
+    { VDP2_TVMD_INTERLACE_SINGLE, VDP2_TVMD_HORZ_NORMAL_B, VDP2_TVMD_VERT_224, 352, 224 }
+};
+
+static constexpr uint32_t _viewport_count = sizeof(_viewports) / sizeof(*_viewports);
 
 static const char* _scene_file_path = "SCENE.BIN";
+static const char* _cmd_stream_file_path = "SCENE.CMD";
 
 static void* _romdisk;
 
+static bool _cd_streaming = false;
+
 static smpc_peripheral_digital_t _digital;
 
-static vdp1_cmdt_list_t* _scene_cmdt_list;
-static uint32_t _cmdt_buffer_index;
+/* Filled in by the decoder for every frame. Times are in FRT ticks */
+struct frame_stats {
+    uint16_t frame_index;
+    uint16_t decode_ticks;
+    uint16_t cmdt_count;
+    uint16_t vertex_count;
+    uint16_t palette_count;
+    uint16_t dropped_count;
+};
+
+/* A decoded frame, waiting to be submitted or in flight to VDP1 VRAM */
+struct frame_slot {
+    frame_stats stats;
+    vdp1_cmdt_list_t* cmdt_list;
+    color_rgb1555_t palette[16];
+    /* Bit n is set if palette entry n changed */
+    uint16_t palette_dirty_mask;
+    bool clear_screen;
+    /* Viewport the frame was scaled to, which is what it's clipped to */
+    uint32_t viewport_index;
+};
+
+/* Single-producer/single-consumer ring of decoded frames. Slots in
+ * [tail, head) belong to the master: submitted slots are released (tail is
+ * advanced) once vdp1_sync is done with their command list. The decoder
+ * only ever writes head and the master only ever writes tail, so no lock is
+ * needed as long as both are kept uncached */
+static frame_slot _frame_slots[_frame_slot_count];
+static uint32_t _cmdt_capacity = _cmdt_capacity_default;
+static volatile uint32_t _frame_queue_head __section(".uncached") = 0;
+static volatile uint32_t _frame_queue_tail __section(".uncached") = 0;
+static uint32_t _frame_queue_submit = 0;
+
+/* Rolling window of the last submitted frames, only touched by the master */
+struct stats_sample {
+    frame_stats frame;
+    uint16_t submit_ticks;
+};
+
+static stats_sample _stats_samples[_stats_window_size];
+static uint32_t _stats_sample_count = 0;
+static bool _stats_overlay = false;
+
+/* Requested by the master, picked up by the decoder at the start of the next
+ * frame. Frames already in the queue are still drawn at the old scale */
+static volatile uint32_t _viewport_index __section(".uncached") = 0;
+
+/* Requested by the master, picked up by the decoder before the next frame.
+ * Frames already in the queue are still drawn. _seek_none if there's no
+ * request pending */
+static volatile uint32_t _seek_frame_index __section(".uncached") = _seek_none;
+
+/* Zero if the scene isn't indexed, in which case it can't be seeked */
+static uint32_t _scene_frame_count = 0;
 
+/* Index of the last frame submitted, only touched by the master */
+static uint32_t _submit_frame_index = 0;
+
+/* Master owned copy of the dirty palette range. The slot itself may be
+ * reused by the decoder before the CRAM transfer in VBLANK-IN happens */
+static color_rgb1555_t _cram_staging[16] __aligned(32);
+
+/* Decoder state, only touched by the decoding CPU */
+static frame_slot* _decode_slot = nullptr;
+static uint32_t _cmdt_buffer_index;
 static color_rgb1555_t _palette[16] __aligned(32);
+static uint16_t _palette_dirty_mask;
+static uint16_t _decode_start_ticks;
+
+/* Maps the scene's 8-bit coordinates to the viewport. A lookup is cheaper
+ * than a multiply per coordinate */
+static int16_t _viewport_lut_x[256];
+static int16_t _viewport_lut_y[256];
+static uint32_t _viewport_lut_index;
+
+static const cmd_stream::header* _cmd_stream;
+static const cmd_stream::frame_header* _cmd_stream_frame;
+static vdp1_cmdt_list_t _cmd_stream_cmdt_list;
 
 static void _romdisk_init(void);
 
+static void _scene_validate(void);
+
 static void _draw_init(void);
+static void _cmdt_list_init(vdp1_cmdt_list_t *);
+
+static void _viewport_set(uint32_t);
+static void _viewport_luts_build(uint32_t);
+static void _system_clip_set(vdp1_cmdt_list_t *, uint32_t);
+
+static bool _frame_decode(void);
+static void _seek_request(int32_t);
+static void _frame_submit(void);
+static void _frame_put_done(void *);
+
+static void _slave_entry(void);
+
+static uint16_t _ticks_get(void);
+static uint32_t _ticks_us_convert(uint32_t);
+
+static void _stats_sample_add(const frame_stats&, uint16_t);
+static void _stats_usb_cart_print(const stats_sample&);
+static void _stats_overlay_print(void);
+
+static void _cmd_stream_init(void *);
+static void _cmd_stream_frame_process(void);
+
+static void _cram_dma_enqueue(uint32_t, uint32_t, const void *);
 
 static void _vblank_out_handler(void *);
 
@@ -48,47 +202,99 @@ static void _on_start(uint32_t, bool);
 static void _on_end(uint32_t, bool);
 static void _on_clear_screen(bool);
 static void _on_update_palette(uint8_t, const scene::rgb444);
-static void _on_draw(int16_vec2_t const *, const size_t, const uint8_t);
-
-static void _on_draw_polygon3(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon4(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon5(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon6(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon7(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-
-static const scene::draw_handler _draw_handlers[] = {
-    nullptr, // 0
-    nullptr, // 1
-    nullptr, // 2
-    _on_draw_polygon3,
-    _on_draw_polygon4,
-    _on_draw_polygon5,
-    _on_draw_polygon6,
-    _on_draw_polygon7
+static void _on_palette_changed(uint16_t);
+
+static void _clear_screen_set(bool);
+
+// Writes polygons straight into the decoding slot's command list while the
+// frame is being decoded. Per-frame events go through the regular handlers
+struct vdp1_emitter {
+    inline void on_start(uint32_t frame_index, bool first_frame) {
+        _on_start(frame_index, first_frame);
+    }
+
+    inline void on_end(uint32_t frame_index, bool last_frame) {
+        _on_end(frame_index, last_frame);
+    }
+
+    inline void on_update_palette(uint8_t palette_index,
+                                  const scene::rgb444 color) {
+        _on_update_palette(palette_index, color);
+    }
+
+    inline void on_palette_changed(uint16_t changed_mask) {
+        _on_palette_changed(changed_mask);
+    }
+
+    inline void on_clear_screen(bool clear_screen) {
+        _on_clear_screen(clear_screen);
+    }
+
+    inline void on_transform(int16_vec2_t* vertex_buffer, const size_t count);
+
+    inline void on_draw(int16_vec2_t const * vertex_buffer,
+                        const size_t count,
+                        const uint8_t palette_index);
 };
 
+static vdp1_emitter _emitter;
+
 void main(void) {
     _romdisk_init();
 
-    dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+    if (_stats_usb_cart_dump) {
+        dbgio_dev_default_init(DBGIO_DEV_USB_CART);
+    } else {
+        dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+    }
+
     dbgio_dev_font_load();
     dbgio_dev_font_load_wait();
 
-    _draw_init();
+    /* Play the precompiled command stream if one was generated (see
+     * host/scene-convert), otherwise decode SCENE.BIN on the fly */
+    void *cmd_fh = romdisk_open(_romdisk, _cmd_stream_file_path);
+
+    if (cmd_fh != NULL) {
+        _draw_init();
 
-    void *fh = romdisk_open(_romdisk, _scene_file_path);
-    assert(fh != NULL);
-    void *scene_ptr = romdisk_direct(fh);
-    const uint8_t* scene_buffer = static_cast<uint8_t*>(scene_ptr);
+        _cmd_stream_init(romdisk_direct(cmd_fh));
+    } else {
+        if (_cd_stream_enable) {
+            /* When decoding on the master, it also has to refill while
+             * waiting on a chunk */
+            _cd_streaming = cd_stream::init(_scene_file_path, !_slave_decode);
+        }
+
+        if (_cd_streaming) {
+            scene::init(cd_stream::chunk_get);
+        } else {
+            void *fh = romdisk_open(_romdisk, _scene_file_path);
+            assert(fh != NULL);
+            void *scene_ptr = romdisk_direct(fh);
+            const uint8_t* scene_buffer = static_cast<uint8_t*>(scene_ptr);
+
+            scene::init(scene_buffer, romdisk_total(fh));
+
+            if (_validate_scene) {
+                _scene_validate();
+            }
 
-    scene::callbacks callbacks;
-    callbacks.on_start = _on_start;
-    callbacks.on_end = _on_end;
-    callbacks.on_clear_screen = _on_clear_screen;
-    callbacks.on_update_palette = _on_update_palette;
-    callbacks.on_draw = _on_draw;
+            scene::index_build();
 
-    scene::init(scene_buffer, callbacks);
+            _scene_frame_count = scene::frame_count();
+        }
+
+        _draw_init();
+
+        if (_slave_decode) {
+            /* Not CPU_DUAL_ENTRY_ICI: the slave is woken through its FRT
+             * input capture interrupt in that mode, and _slave_entry() sets
+             * up the slave's FRT for timing the decode */
+            cpu_dual_comm_mode_set(CPU_DUAL_ENTRY_POLLING);
+            cpu_dual_slave_set(_slave_entry);
+        }
+    }
 
     bool start_state = false;
 
@@ -106,14 +312,59 @@ void main(void) {
             process_frame = true;
         }
 
-        if (process_frame) {
-            dbgio_puts("[H[2J");
+        if ((_digital.pressed.button.start) != 0) {
+            _viewport_set((_viewport_index + 1) % _viewport_count);
+        }
 
-            scene::process_frame();
+        if ((_scene_frame_count > 0) && (_seek_frame_index == _seek_none)) {
+            if ((_digital.pressed.button.left) != 0) {
+                _seek_request(-static_cast<int32_t>(_seek_frame_step));
+            } else if ((_digital.pressed.button.right) != 0) {
+                _seek_request(_seek_frame_step);
+            }
+        }
 
+        if ((_digital.pressed.button.a) != 0) {
+            _stats_overlay ^= true;
+
+            dbgio_puts("[H[2J");
             dbgio_flush();
         }
 
+        if (process_frame) {
+            if (_debug_vram_dump) {
+                dbgio_puts("[H[2J");
+            }
+
+            if (_cmd_stream != nullptr) {
+                _cmd_stream_frame_process();
+            } else {
+                if (!_slave_decode) {
+                    _frame_decode();
+                }
+
+                _frame_submit();
+            }
+
+            if (_debug_vram_dump) {
+                dbgio_flush();
+            }
+        }
+
+        if (_stats_overlay && !_stats_usb_cart_dump) {
+            _stats_overlay_print();
+        }
+
+        /* Have the slave refill whatever slots were released */
+        if ((_cmd_stream == nullptr) && _slave_decode) {
+            cpu_dual_slave_notify();
+        }
+
+        /* Read ahead while the slave decodes */
+        if (_cd_streaming) {
+            cd_stream::refill();
+        }
+
         vdp_sync();
     }
 
@@ -123,30 +374,17 @@ void main(void) {
 void user_init(void) {
     cpu_cache_disable();
 
-    vdp2_tvmd_display_res_set(VDP2_TVMD_INTERLACE_NONE, VDP2_TVMD_HORZ_NORMAL_A,
-                              VDP2_TVMD_VERT_240);
-
     vdp2_scrn_back_screen_color_set(VDP2_VRAM_ADDR(3, 0x01FFFE), COLOR_RGB1555(1, 7, 7, 7));
 
     vdp2_sprite_priority_set(0, 6);
 
     cpu_intc_mask_set(0);
 
-    vdp2_tvmd_display_set();
-
-    vdp1_env_t vdp1_env;
+    _viewport_set(_viewport_index);
 
-    vdp1_env.erase_color = COLOR_RGB1555(0, 0, 0, 0);
-    vdp1_env.erase_points[0].x = 0;
-    vdp1_env.erase_points[0].y = 0;
-    vdp1_env.erase_points[1].x = _screen_width - 1;
-    vdp1_env.erase_points[1].y = _screen_height - 1;
-    vdp1_env.bpp = VDP1_ENV_BPP_16;
-    vdp1_env.rotation = VDP1_ENV_ROTATION_0;
-    vdp1_env.color_mode = VDP1_ENV_COLOR_MODE_RGB_PALETTE;
-    vdp1_env.sprite_type = 0x0;
+    vdp2_tvmd_display_set();
 
-    vdp1_env_set(&vdp1_env);
+    cpu_frt_init(CPU_FRT_CLOCK_DIV_128);
 
     vdp_sync_vblank_out_set(_vblank_out_handler);
 }
@@ -160,11 +398,43 @@ static void _romdisk_init(void) {
     assert(_romdisk != NULL);
 }
 
+static void _scene_validate(void) {
+    scene::validation validation;
+
+    scene::validate(validation);
+
+    if (!validation.valid) {
+        dbgio_printf("%s: %s\nframe %lu, offset 0x%08lX\n",
+                     _scene_file_path, validation.error,
+                     validation.frame_index, validation.offset);
+        dbgio_flush();
+
+        while (true) {
+            vdp_sync();
+        }
+    }
+
+    if (validation.max_quad_count > _cmdt_capacity_default) {
+        _cmdt_capacity = (validation.max_quad_count < _cmdt_capacity_max)
+            ? validation.max_quad_count
+            : _cmdt_capacity_max;
+    }
+}
+
 static void _draw_init(void) {
-    constexpr int16_vec2_t system_clip_coord =
-        INT16_VEC2_INITIALIZER(_screen_width - 1,
-                               _screen_height - 1);
+    /* Preamble, polygons and the end command */
+    const uint32_t cmdt_count = ORDER_BUFFER_STARTING_INDEX + _cmdt_capacity + 1;
+
+    for (uint32_t i = 0; i < _frame_slot_count; i++) {
+        _frame_slots[i].cmdt_list = vdp1_cmdt_list_alloc(cmdt_count);
+
+        _cmdt_list_init(_frame_slots[i].cmdt_list);
+    }
 
+    _viewport_luts_build(_viewport_index);
+}
+
+static void _cmdt_list_init(vdp1_cmdt_list_t *cmdt_list) {
     constexpr int16_vec2_t local_coord_ul =
         INT16_VEC2_INITIALIZER(0,
                                0);
@@ -173,53 +443,396 @@ static void _draw_init(void) {
     polygon_draw_mode.raw = 0x0000;
     polygon_draw_mode.bits.pre_clipping_disable = true;
 
-    _scene_cmdt_list = vdp1_cmdt_list_alloc(ORDER_COUNT);
+    vdp1_cmdt_t* const cmdts = cmdt_list->cmdts;
 
-    vdp1_cmdt_t* const cmdts = _scene_cmdt_list->cmdts;
+    const uint32_t cmdt_count = ORDER_BUFFER_STARTING_INDEX + _cmdt_capacity + 1;
 
-    (void)memset(&cmdts[0], 0x00, ORDER_COUNT * sizeof(vdp1_cmdt));
+    (void)memset(&cmdts[0], 0x00, cmdt_count * sizeof(vdp1_cmdt));
 
     vdp1_cmdt_system_clip_coord_set(&cmdts[ORDER_SYSTEM_CLIP_COORDS_INDEX]);
-    vdp1_cmdt_param_vertex_set(&cmdts[ORDER_SYSTEM_CLIP_COORDS_INDEX], CMDT_VTX_SYSTEM_CLIP, &system_clip_coord);
+    _system_clip_set(cmdt_list, _viewport_index);
 
     vdp1_cmdt_local_coord_set(&cmdts[ORDER_LOCAL_COORDS_INDEX]);
     vdp1_cmdt_param_vertex_set(&cmdts[ORDER_LOCAL_COORDS_INDEX], CMDT_VTX_LOCAL_COORD, &local_coord_ul);
 
-    for (uint32_t i = ORDER_BUFFER_STARTING_INDEX; i < ORDER_BUFFER_END_INDEX; i++) {
+    for (uint32_t i = ORDER_BUFFER_STARTING_INDEX; i < (cmdt_count - 1); i++) {
         vdp1_cmdt_param_draw_mode_set(&cmdts[i], polygon_draw_mode);
     }
 
     vdp1_cmdt_end_set(&cmdts[ORDER_BUFFER_STARTING_INDEX]);
 }
 
+static void _viewport_set(uint32_t viewport_index) {
+    const viewport& viewport = _viewports[viewport_index];
+
+    vdp2_tvmd_display_res_set(viewport.interlace, viewport.horz, viewport.vert);
+
+    vdp1_env_t vdp1_env;
+
+    vdp1_env.erase_color = COLOR_RGB1555(0, 0, 0, 0);
+    vdp1_env.erase_points[0].x = 0;
+    vdp1_env.erase_points[0].y = 0;
+    vdp1_env.erase_points[1].x = viewport.width - 1;
+    vdp1_env.erase_points[1].y = viewport.height - 1;
+    vdp1_env.bpp = VDP1_ENV_BPP_16;
+    vdp1_env.rotation = VDP1_ENV_ROTATION_0;
+    vdp1_env.color_mode = VDP1_ENV_COLOR_MODE_RGB_PALETTE;
+    vdp1_env.sprite_type = 0x0;
+
+    vdp1_env_set(&vdp1_env);
+
+    _viewport_index = viewport_index;
+}
+
+static void _viewport_luts_build(uint32_t viewport_index) {
+    const viewport& viewport = _viewports[viewport_index];
+
+    for (uint32_t i = 0; i < 256; i++) {
+        _viewport_lut_x[i] = (i * viewport.width) / _render_width;
+        _viewport_lut_y[i] = (i * viewport.height) / _render_height;
+    }
+
+    _viewport_lut_index = viewport_index;
+}
+
+static void _system_clip_set(vdp1_cmdt_list_t *cmdt_list, uint32_t viewport_index) {
+    const viewport& viewport = _viewports[viewport_index];
+
+    int16_vec2_t system_clip_coord;
+    system_clip_coord.x = viewport.width - 1;
+    system_clip_coord.y = viewport.height - 1;
+
+    vdp1_cmdt_param_vertex_set(&cmdt_list->cmdts[ORDER_SYSTEM_CLIP_COORDS_INDEX],
+                               CMDT_VTX_SYSTEM_CLIP, &system_clip_coord);
+}
+
+static bool _frame_decode(void) {
+    /* Wait for the master to release the oldest slot */
+    if ((_frame_queue_head - _frame_queue_tail) >= _frame_slot_count) {
+        return false;
+    }
+
+    const uint32_t seek_frame_index = _seek_frame_index;
+
+    if (seek_frame_index != _seek_none) {
+        scene::seek(seek_frame_index, _emitter);
+
+        _seek_frame_index = _seek_none;
+    }
+
+    scene::process_frame(_emitter);
+
+    return true;
+}
+
+/* Relative to the last frame submitted, and clamped to the scene */
+static void _seek_request(int32_t frame_step) {
+    int32_t frame_index = static_cast<int32_t>(_submit_frame_index) + frame_step;
+
+    if (frame_index < 0) {
+        frame_index = 0;
+    } else if (frame_index >= static_cast<int32_t>(_scene_frame_count)) {
+        frame_index = _scene_frame_count - 1;
+    }
+
+    _seek_frame_index = frame_index;
+}
+
+static void _frame_submit(void) {
+    /* Nothing decoded yet, so the previous frame stays up */
+    if (_frame_queue_submit == _frame_queue_head) {
+        return;
+    }
+
+    const uint16_t start_ticks = _ticks_get();
+
+    const frame_slot* const slot =
+        &_frame_slots[_frame_queue_submit % _frame_slot_count];
+
+    _clear_screen_set(slot->clear_screen);
+    _system_clip_set(slot->cmdt_list, slot->viewport_index);
+
+    const uint16_t palette_dirty_mask = slot->palette_dirty_mask;
+
+    if (palette_dirty_mask != 0x0000) {
+        /* Upload the smallest range covering every changed entry in one
+         * transfer instead of writing the whole palette to CRAM */
+        const uint32_t first = __builtin_ctz(palette_dirty_mask);
+        const uint32_t last = 31 - __builtin_clz(palette_dirty_mask);
+        const uint32_t count = (last - first) + 1;
+
+        (void)memcpy(&_cram_staging[first], &slot->palette[first],
+                     count * sizeof(color_rgb1555_t));
+
+        _cram_dma_enqueue(first, count, &_cram_staging[first]);
+    }
+
+    vdp1_sync_cmdt_list_put(slot->cmdt_list, 0, _frame_put_done, NULL);
+
+    /* Copy the stats out before the slot is released */
+    _stats_sample_add(slot->stats, _ticks_get() - start_ticks);
+
+    _submit_frame_index = slot->stats.frame_index;
+
+    _frame_queue_submit++;
+}
+
+static void _frame_put_done(void *) {
+    /* Lists are transferred in submission order */
+    _frame_queue_tail = _frame_queue_tail + 1;
+}
+
+static void _slave_entry(void) {
+    static bool frt_init = false;
+
+    /* The FRT is per CPU. This is why the slave is polling for entries */
+    if (!frt_init) {
+        cpu_frt_init(CPU_FRT_CLOCK_DIV_128);
+
+        frt_init = true;
+    }
+
+    while (_frame_decode()) {
+    }
+}
+
+/* At 1/128 of the CPU clock, the 16-bit FRT counter wraps around every few
+ * hundred milliseconds, well over the time spent on a frame. So, unlike
+ * vdp1-sega3d, there's no need for an overflow counter (which would also
+ * have to be kept per CPU), as long as differences are taken modulo 2^16 */
+static uint16_t _ticks_get(void) {
+    return cpu_frt_count_get();
+}
+
+static uint32_t _ticks_us_convert(uint32_t ticks) {
+    return (ticks * 1000) / CPU_FRT_NTSC_320_128_COUNT_1MS;
+}
+
+static void _stats_sample_add(const frame_stats& stats, uint16_t submit_ticks) {
+    stats_sample& sample =
+        _stats_samples[_stats_sample_count % _stats_window_size];
+
+    sample.frame = stats;
+    sample.submit_ticks = submit_ticks;
+
+    _stats_sample_count++;
+
+    if (_stats_usb_cart_dump) {
+        _stats_usb_cart_print(sample);
+    }
+}
+
+static void _stats_usb_cart_print(const stats_sample& sample) {
+    /* frame,decode us,submit us,commands,vertices,palette writes,dropped */
+    dbgio_printf("%u,%lu,%lu,%u,%u,%u,%u\n",
+                 sample.frame.frame_index,
+                 _ticks_us_convert(sample.frame.decode_ticks),
+                 _ticks_us_convert(sample.submit_ticks),
+                 sample.frame.cmdt_count,
+                 sample.frame.vertex_count,
+                 sample.frame.palette_count,
+                 sample.frame.dropped_count);
+
+    dbgio_flush();
+}
+
+static void _stats_overlay_print(void) {
+    const uint32_t sample_count =
+        (_stats_sample_count < _stats_window_size) ? _stats_sample_count : _stats_window_size;
+
+    if (sample_count == 0) {
+        return;
+    }
+
+    constexpr uint32_t value_count = 6;
+
+    static const char* const value_names[value_count] = {
+        "decode us",
+        "submit us",
+        "commands",
+        "vertices",
+        "palette",
+        "dropped"
+    };
+
+    uint32_t min[value_count];
+    uint32_t max[value_count];
+    uint32_t sum[value_count];
+
+    uint32_t worst_frame_index = 0;
+
+    for (uint32_t i = 0; i < value_count; i++) {
+        min[i] = UINT32_MAX;
+        max[i] = 0;
+        sum[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < sample_count; i++) {
+        const stats_sample& sample = _stats_samples[i];
+
+        const uint32_t values[value_count] = {
+            _ticks_us_convert(sample.frame.decode_ticks),
+            _ticks_us_convert(sample.submit_ticks),
+            sample.frame.cmdt_count,
+            sample.frame.vertex_count,
+            sample.frame.palette_count,
+            sample.frame.dropped_count
+        };
+
+        if (values[0] > max[0]) {
+            worst_frame_index = sample.frame.frame_index;
+        }
+
+        for (uint32_t j = 0; j < value_count; j++) {
+            min[j] = (values[j] < min[j]) ? values[j] : min[j];
+            max[j] = (values[j] > max[j]) ? values[j] : max[j];
+            sum[j] += values[j];
+        }
+    }
+
+    dbgio_printf("[H[2J%-10s %6s %6s %6s\n", "", "min", "avg", "max");
+
+    for (uint32_t i = 0; i < value_count; i++) {
+        dbgio_printf("%-10s %6lu %6lu %6lu\n",
+                     value_names[i], min[i], sum[i] / sample_count, max[i]);
+    }
+
+    dbgio_printf("\nslowest decode: frame %lu\n", worst_frame_index);
+
+    dbgio_flush();
+}
+
+static void _cmd_stream_init(void *ptr) {
+    _cmd_stream = static_cast<const cmd_stream::header*>(ptr);
+
+    assert(memcmp(_cmd_stream->signature, cmd_stream::signature,
+                  sizeof(cmd_stream::signature)) == 0);
+    assert(_cmd_stream->version == cmd_stream::version);
+
+    _cmd_stream_frame = reinterpret_cast<const cmd_stream::frame_header*>(&_cmd_stream[1]);
+
+    /* Only the system clipping and local coordinates are used from the
+     * scene command list */
+    _frame_slots[0].cmdt_list->count = ORDER_BUFFER_STARTING_INDEX;
+}
+
+static void _cmd_stream_frame_process(void) {
+    const cmd_stream::frame_header* const frame = _cmd_stream_frame;
+    const uintptr_t frame_ptr = reinterpret_cast<uintptr_t>(frame);
+
+    /* Precompiled frames aren't bounded by the converter */
+    assert(frame->cmdt_count <= _cmdt_capacity_max);
+
+    _clear_screen_set((frame->flags & cmd_stream::FRAME_CLEAR_SCREEN) != 0);
+
+    if (frame->palette_count > 0) {
+        _cram_dma_enqueue(frame->palette_first, frame->palette_count,
+                          reinterpret_cast<const void*>(frame_ptr + sizeof(cmd_stream::frame_header)));
+    }
+
+    /* The command tables are already laid out for VDP1 VRAM */
+    _cmd_stream_cmdt_list.cmdts =
+        reinterpret_cast<vdp1_cmdt_t*>(frame_ptr + cmd_stream::cmdts_offset(frame->palette_count));
+    _cmd_stream_cmdt_list.count = frame->cmdt_count;
+
+    /* The command stream is baked at 256x200, so it isn't scaled */
+    _system_clip_set(_frame_slots[0].cmdt_list, _viewport_index);
+
+    vdp1_sync_cmdt_list_put(_frame_slots[0].cmdt_list, 0, NULL, NULL);
+    vdp1_sync_cmdt_list_put(&_cmd_stream_cmdt_list, ORDER_BUFFER_STARTING_INDEX, NULL, NULL);
+
+    if ((frame->flags & cmd_stream::FRAME_LAST) != 0) {
+        _cmd_stream_frame = reinterpret_cast<const cmd_stream::frame_header*>(&_cmd_stream[1]);
+    } else {
+        _cmd_stream_frame = reinterpret_cast<const cmd_stream::frame_header*>(frame_ptr + frame->size);
+    }
+}
+
+static void _cram_dma_enqueue(uint32_t first, uint32_t count, const void *src) {
+    scu_dma_level_cfg_t scu_dma_level_cfg;
+    scu_dma_handle_t handle;
+
+    scu_dma_level_cfg.mode = SCU_DMA_MODE_DIRECT;
+    scu_dma_level_cfg.stride = SCU_DMA_STRIDE_2_BYTES;
+    scu_dma_level_cfg.update = SCU_DMA_UPDATE_NONE;
+    scu_dma_level_cfg.xfer.direct.len = count * sizeof(color_rgb1555_t);
+    scu_dma_level_cfg.xfer.direct.dst = VDP2_CRAM_ADDR(0x10 + first);
+    /* SCU DMA reads memory directly, never through the master's cache */
+    scu_dma_level_cfg.xfer.direct.src =
+        CPU_CACHE_THROUGH | reinterpret_cast<uintptr_t>(src);
+
+    scu_dma_config_buffer(&handle, &scu_dma_level_cfg);
+
+    int8_t ret __unused;
+    ret = dma_queue_enqueue(&handle, DMA_QUEUE_TAG_VBLANK_IN, NULL, NULL);
+    assert(ret == 0);
+}
+
 static void _vblank_out_handler(void *) {
     smpc_peripheral_intback_issue();
 }
 
-static void _on_start(uint32_t, bool) {
-}
+static void _on_start(uint32_t frame_index, bool) {
+    _decode_start_ticks = _ticks_get();
 
-static void _on_end(uint32_t frame_index, bool last_frame) {
-    const uint32_t prev_buffer_index = _cmdt_buffer_index;
+    _decode_slot = &_frame_slots[_frame_queue_head % _frame_slot_count];
+
+    frame_stats& stats = _decode_slot->stats;
+
+    stats.frame_index = frame_index;
+    stats.vertex_count = 0;
+    stats.palette_count = 0;
+    stats.dropped_count = 0;
+
+    const uint32_t viewport_index = _viewport_index;
+
+    if (viewport_index != _viewport_lut_index) {
+        _viewport_luts_build(viewport_index);
+    }
+
+    _decode_slot->viewport_index = viewport_index;
 
     _cmdt_buffer_index = 0;
+}
 
-    dbgio_printf("i: %li, frame_index: %li\n", prev_buffer_index, frame_index);
+static void _on_end(uint32_t frame_index, bool last_frame) {
+    if (_debug_vram_dump && !_slave_decode) {
+        dbgio_printf("i: %lu, frame_index: %lu\n", _cmdt_buffer_index, frame_index);
 
-    for (uint32_t i = 0; i < 28; i++) {
-        dbgio_printf("%3li. 0x%03X: 0x%04X\n", i, (uint16_t)(i << 5), MEMORY_READ(16, VDP1_VRAM(i << 5)));
+        for (uint32_t i = 0; i < 28; i++) {
+            dbgio_printf("%3lu. 0x%03X: 0x%04X\n", i, (uint16_t)(i << 5), MEMORY_READ(16, VDP1_VRAM(i << 5)));
+        }
     }
 
+    frame_stats& stats = _decode_slot->stats;
+
+    stats.decode_ticks = _ticks_get() - _decode_start_ticks;
+    stats.cmdt_count = _cmdt_buffer_index;
+
+    vdp1_cmdt_list_t* const cmdt_list = _decode_slot->cmdt_list;
+
     const uint16_t end_index = ORDER_BUFFER_STARTING_INDEX +
-        prev_buffer_index;
+        _cmdt_buffer_index;
 
-    vdp1_cmdt* const end_cmdt = &_scene_cmdt_list->cmdts[end_index];
+    vdp1_cmdt* const end_cmdt = &cmdt_list->cmdts[end_index];
 
     vdp1_cmdt_end_set(end_cmdt);
 
-    _scene_cmdt_list->count = end_index + 1;
+    cmdt_list->count = end_index + 1;
+
+    _decode_slot->palette_dirty_mask = _palette_dirty_mask;
+
+    if (_palette_dirty_mask != 0x0000) {
+        (void)memcpy(&_decode_slot->palette[0], &_palette[0], sizeof(_palette));
+
+        _palette_dirty_mask = 0x0000;
+    }
+
+    /* Publish the slot only once it's completely written. It's the master's
+     * from here on */
+    _frame_queue_head = _frame_queue_head + 1;
 
-    vdp1_sync_cmdt_list_put(_scene_cmdt_list, NULL, NULL);
+    _decode_slot = nullptr;
 
     if (last_frame) {
         scene::reset();
@@ -237,10 +850,21 @@ static void _on_update_palette(uint8_t palette_index,
 
     _palette[palette_index] = rgb1555_color;
 
-    (void)memcpy((void*)VDP2_CRAM_ADDR(0x10), &_palette[0], sizeof(_palette));
+    /* scene::seek() delivers the palette between frames */
+    if (_decode_slot != nullptr) {
+        _decode_slot->stats.palette_count++;
+    }
+}
+
+static void _on_palette_changed(uint16_t changed_mask) {
+    _palette_dirty_mask |= changed_mask;
 }
 
-static void _on_clear_screen(bool clear_screen __unused) {
+static void _on_clear_screen(bool clear_screen) {
+    _decode_slot->clear_screen = clear_screen;
+}
+
+static void _clear_screen_set(bool clear_screen) {
     if (!clear_screen) {
         vdp1_sync_mode_set(VDP1_SYNC_MODE_CHANGE_ONLY);
     } else {
@@ -248,330 +872,70 @@ static void _on_clear_screen(bool clear_screen __unused) {
     }
 }
 
+/* Scales into the viewport. In index mode, this is done once per frame on
+ * the shared vertex pool */
+inline void vdp1_emitter::on_transform(int16_vec2_t* vertex_buffer,
+                                       const size_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        int16_vec2_t& vertex = vertex_buffer[i];
+
+        vertex.x = _viewport_lut_x[static_cast<uint8_t>(vertex.x)];
+        vertex.y = _viewport_lut_y[static_cast<uint8_t>(vertex.y)];
+    }
+}
+
 static inline __always_inline void _vertex_set(int16_t& x,
                                                int16_t& y,
                                                int16_vec2_t const& vertex) {
     x = vertex.x;
     y = vertex.y;
-    // x = fix16_int16_mul(_scale_width, vertex.x) >> 16;
-    // y = fix16_int16_mul(_scale_height, vertex.y) >> 16;
-}
-
-static void _on_draw_polygon3(int16_vec2_t const * vertex_buffer __unused,
-                              const size_t count __unused,
-                              const uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
-
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(cmdt);
-    vdp1_cmdt_param_color_bank_set(cmdt, color_bank);
-
-    int16_vec2_t out_v[3];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-
-    cmdt->cmd_xa = out_v[0].x;
-    cmdt->cmd_ya = out_v[0].y;
-
-    cmdt->cmd_xb = out_v[1].x;
-    cmdt->cmd_yb = out_v[1].y;
-
-    cmdt->cmd_xc = out_v[1].x;
-    cmdt->cmd_yc = out_v[1].y;
-
-    cmdt->cmd_xd = out_v[2].x;
-    cmdt->cmd_yd = out_v[2].y;
-
-    _cmdt_buffer_index++;
 }
 
-static void _on_draw_polygon4(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
-
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(cmdt);
-    vdp1_cmdt_param_color_bank_set(cmdt, color_bank);
+inline void vdp1_emitter::on_draw(int16_vec2_t const * vertex_buffer,
+                                  const size_t count,
+                                  const uint8_t palette_index) {
+    if (count < 3) {
+        return;
+    }
 
-    _vertex_set(cmdt->cmd_xa, cmdt->cmd_ya, vertex_buffer[0]);
-    _vertex_set(cmdt->cmd_xb, cmdt->cmd_yb, vertex_buffer[1]);
-    _vertex_set(cmdt->cmd_xc, cmdt->cmd_yc, vertex_buffer[2]);
-    _vertex_set(cmdt->cmd_xd, cmdt->cmd_yd, vertex_buffer[3]);
+    /* Never write past the end of the list */
+    if ((_cmdt_buffer_index + ((count - 1) / 2)) > _cmdt_capacity) {
+        _decode_slot->stats.dropped_count++;
 
-    _cmdt_buffer_index++;
-}
+        return;
+    }
 
-static void _on_draw_polygon5(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
     /* Specify the CRAM offset */
     vdp1_cmdt_color_bank_t color_bank;
     color_bank.raw = 0x0000;
     color_bank.type_0.data.dc = palette_index + 0x10;
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-
-    int16_vec2_t out_v[5];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    _cmdt_buffer_index += 3;
-}
-
-static void _on_draw_polygon6(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+    vdp1_cmdt* cmdt =
+        &_decode_slot->cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
+
+    /* Quad fan around vertex_buffer[0]. The polygons are convex, so each
+     * quad covers two triangles of the fan:
+     *   vertex_buffer[0]
+     *   vertex_buffer[i]
+     *   vertex_buffer[i + 1]
+     *   vertex_buffer[i + 2]
+     *
+     * With an odd number of triangles, the last quad is a triangle (D == C).
+     * This takes (count - 1) / 2 commands, including a single command for
+     * triangles and quads */
+    for (uint32_t i = 1; i < (count - 1); i += 2, cmdt++) {
+        const uint32_t d = ((i + 2) < count) ? (i + 2) : (i + 1);
+
+        vdp1_cmdt_polygon_set(cmdt);
+        vdp1_cmdt_param_color_bank_set(cmdt, color_bank);
+
+        _vertex_set(cmdt->cmd_xa, cmdt->cmd_ya, vertex_buffer[0]);
+        _vertex_set(cmdt->cmd_xb, cmdt->cmd_yb, vertex_buffer[i]);
+        _vertex_set(cmdt->cmd_xc, cmdt->cmd_yc, vertex_buffer[i + 1]);
+        _vertex_set(cmdt->cmd_xd, cmdt->cmd_yd, vertex_buffer[d]);
+    }
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[3]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[3], color_bank);
-
-    int16_vec2_t out_v[6];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-    _vertex_set(out_v[5].x, out_v[5].y, vertex_buffer[5]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[4]
-    // vertex_buffer[4]
-    // vertex_buffer[5]
-    cmdt[3].cmd_xa = out_v[0].x;
-    cmdt[3].cmd_ya = out_v[0].y;
-    cmdt[3].cmd_xb = out_v[4].x;
-    cmdt[3].cmd_yb = out_v[4].y;
-    cmdt[3].cmd_xc = out_v[4].x;
-    cmdt[3].cmd_yc = out_v[4].y;
-    cmdt[3].cmd_xd = out_v[5].x;
-    cmdt[3].cmd_yd = out_v[5].y;
-
-    _cmdt_buffer_index += 4;
-}
-
-static void _on_draw_polygon7(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+    _cmdt_buffer_index += (count - 1) / 2;
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[3]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[3], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[4]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[4], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[5]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[5], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[6]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[6], color_bank);
-
-    int16_vec2_t out_v[7];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-    _vertex_set(out_v[5].x, out_v[5].y, vertex_buffer[5]);
-    _vertex_set(out_v[6].x, out_v[6].y, vertex_buffer[6]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[4]
-    // vertex_buffer[4]
-    // vertex_buffer[5]
-    cmdt[3].cmd_xa = out_v[0].x;
-    cmdt[3].cmd_ya = out_v[0].y;
-    cmdt[3].cmd_xb = out_v[4].x;
-    cmdt[3].cmd_yb = out_v[4].y;
-    cmdt[3].cmd_xc = out_v[4].x;
-    cmdt[3].cmd_yc = out_v[4].y;
-    cmdt[3].cmd_xd = out_v[5].x;
-    cmdt[3].cmd_yd = out_v[5].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[5]
-    // vertex_buffer[5]
-    // vertex_buffer[6]
-    cmdt[4].cmd_xa = out_v[0].x;
-    cmdt[4].cmd_ya = out_v[0].y;
-    cmdt[4].cmd_xb = out_v[5].x;
-    cmdt[4].cmd_yb = out_v[5].y;
-    cmdt[4].cmd_xc = out_v[5].x;
-    cmdt[4].cmd_yc = out_v[5].y;
-    cmdt[4].cmd_xd = out_v[6].x;
-    cmdt[4].cmd_yd = out_v[6].y;
-
-    _cmdt_buffer_index += 5;
-}
-
-static void _on_draw(int16_vec2_t const * vertex_buffer,
-                     size_t count,
-                     uint8_t palette_index) {
-    _draw_handlers[count](vertex_buffer, count, palette_index);
+    _decode_slot->stats.vertex_count += count;
 }